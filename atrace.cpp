@@ -0,0 +1,212 @@
+#include <cstddef>
+#include <cstdio>
+#include <ctime>
+#include <thread>
+
+#include "atrace.h"
+
+namespace atrace {
+
+std::atomic<uint8_t> runtimeLevel{ATRACE_LEVEL};
+
+void setLevel(Level level)
+{
+    runtimeLevel.store(uint8_t(level), std::memory_order_relaxed);
+}
+
+namespace {
+
+/* bounded multi-producer/single-consumer ring (D. Vyukov),
+ * each slot carries sequence number which tells if slot is free for
+ * producer (seq == pos) or ready for consumer (seq == pos + 1) */
+class Ring
+{
+    static constexpr std::size_t size_ = 1024;
+    static constexpr std::size_t mask_ = size_ - 1;
+    static_assert(0 == (size_ & mask_), "size has to be power of 2");
+
+    struct Slot
+    {
+        std::atomic<std::size_t> seq;
+        Record record;
+    };
+
+    Slot slots_[size_];
+    alignas(64) std::atomic<std::size_t> head_{0};
+    alignas(64) std::size_t tail_{0};
+public:
+    Ring()
+    {
+        for(std::size_t i = 0; i < size_; ++i)
+        {
+            slots_[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool push(const Record &record)
+    {
+        auto pos = head_.load(std::memory_order_relaxed);
+
+        for(;;)
+        {
+            auto &slot = slots_[pos & mask_];
+            const auto seq = slot.seq.load(std::memory_order_acquire);
+            const auto diff = intptr_t(seq) - intptr_t(pos);
+
+            if(0 == diff)
+            {
+                if(
+                    head_.compare_exchange_weak(
+                        pos, pos + 1,
+                        std::memory_order_relaxed))
+                {
+                    /* copy only used part of record */
+                    std::memcpy(
+                        &slot.record, &record,
+                        offsetof(Record, data) + record.size);
+                    slot.seq.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            }
+            else if(0 > diff) return false;
+            else pos = head_.load(std::memory_order_relaxed);
+        }
+    }
+
+    /* single consumer only */
+    template <typename F>
+    bool pop(F &&f)
+    {
+        auto &slot = slots_[tail_ & mask_];
+
+        if(slot.seq.load(std::memory_order_acquire) != tail_ + 1) return false;
+
+        f(slot.record);
+        slot.seq.store(tail_ + size_, std::memory_order_release);
+        ++tail_;
+        return true;
+    }
+
+    bool empty() const
+    {
+        return
+            slots_[tail_ & mask_].seq.load(std::memory_order_acquire)
+            != tail_ + 1;
+    }
+};
+
+const char *toString(Level level)
+{
+    switch(level)
+    {
+        case Level::Error: return "ERROR";
+        case Level::Warning: return "WARNING";
+        case Level::Info: return "INFO";
+        case Level::Debug: return "DEBUG";
+    }
+    return "?";
+}
+
+void write(const Record &record)
+{
+    using namespace std::chrono;
+
+    const auto sinceEpoch = record.timestamp.time_since_epoch();
+    const auto sec = duration_cast<seconds>(sinceEpoch);
+    const auto usec = duration_cast<microseconds>(sinceEpoch - sec);
+    const std::time_t time = sec.count();
+    std::tm tm;
+    char timestamp[32];
+
+    ::localtime_r(&time, &tm);
+    std::strftime(timestamp, sizeof(timestamp), "%H:%M:%S", &tm);
+    std::fprintf(
+        stderr, "%s.%06ld %s %.*s%s\n",
+        timestamp, long(usec.count()), toString(record.level),
+        int(record.size), record.data,
+        record.truncated ? " [truncated]" : "");
+}
+
+class Sink
+{
+    Ring ring_;
+    std::atomic<uint64_t> dropped_{0};
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+
+    void drain()
+    {
+        while(ring_.pop([](const Record &record){write(record);})) {}
+        std::fflush(stderr);
+    }
+
+    void run()
+    {
+        while(!stop_.load(std::memory_order_acquire))
+        {
+            if(ring_.empty())
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds{1});
+                continue;
+            }
+            drain();
+        }
+        drain();
+    }
+public:
+    Sink():
+        thread_{[this](){run();}}
+    {}
+
+    ~Sink()
+    {
+        stop_.store(true, std::memory_order_release);
+        thread_.join();
+
+        if(const auto dropped = dropped_.load())
+        {
+            std::fprintf(
+                stderr, "atrace: %llu records dropped\n",
+                static_cast<unsigned long long>(dropped));
+        }
+    }
+
+    bool push(const Record &record)
+    {
+        if(ring_.push(record)) return true;
+
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+};
+
+Sink &sink()
+{
+    static Sink sink;
+    return sink;
+}
+
+} /* namespace */
+
+bool push(const Record &record)
+{
+    return sink().push(record);
+}
+
+namespace detail {
+
+std::ostringstream &stream()
+{
+    static const std::ostringstream defaultFormat;
+    thread_local std::ostringstream oss;
+
+    /* streamed types may leave manipulators (std::hex etc.) behind */
+    oss.str({});
+    oss.clear();
+    oss.copyfmt(defaultFormat);
+    return oss;
+}
+
+} /* detail */
+
+} /* atrace */
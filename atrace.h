@@ -0,0 +1,224 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+/* Asynchronous trace:
+ *
+ * ATRACE(level, args...)
+ *
+ * - levels above ATRACE_LEVEL are removed at compile time
+ * - runtime level (atrace::setLevel) is checked before any argument
+ *   is evaluated, callable arguments are invoked only if record is emitted
+ * - enabled records are formatted into fixed size buffer and pushed to
+ *   lock-free ring drained by background thread, producer never blocks
+ *   (record is dropped if ring is full), records longer than
+ *   Record::capacity are cut and marked "[truncated]" */
+
+#ifndef ATRACE_LEVEL
+#define ATRACE_LEVEL 3
+#endif
+
+namespace atrace {
+
+enum class Level : uint8_t
+{
+    Error = 0,
+    Warning = 1,
+    Info = 2,
+    Debug = 3
+};
+
+constexpr bool compiled(Level level)
+{
+    return uint8_t(level) <= ATRACE_LEVEL;
+}
+
+extern std::atomic<uint8_t> runtimeLevel;
+
+inline
+bool enabled(Level level)
+{
+    return uint8_t(level) <= runtimeLevel.load(std::memory_order_relaxed);
+}
+
+void setLevel(Level level);
+
+struct Record
+{
+    static constexpr std::size_t capacity = 1000;
+
+    std::chrono::system_clock::time_point timestamp;
+    Level level;
+    /* data did not fit, marked when written */
+    bool truncated;
+    uint16_t size;
+    char data[capacity];
+
+    void append(const char *src, std::size_t num)
+    {
+        if(num > capacity - size)
+        {
+            num = capacity - size;
+            truncated = true;
+        }
+        std::memcpy(data + size, src, num);
+        size += num;
+    }
+};
+
+/* push to ring, returns false if record was dropped */
+bool push(const Record &record);
+
+namespace detail {
+
+template <typename T, typename = void>
+struct IsCallable : std::false_type {};
+
+template <typename T>
+struct IsCallable<T, decltype(void(std::declval<T &>()()))> : std::true_type {};
+
+std::ostringstream &stream();
+
+inline
+void format(Record &record, const char *str)
+{
+    record.append(str, std::strlen(str));
+}
+
+inline
+void format(Record &record, char *str)
+{
+    format(record, static_cast<const char *>(str));
+}
+
+inline
+void format(Record &record, const std::string &str)
+{
+    record.append(str.data(), str.size());
+}
+
+inline
+void format(Record &record, char c)
+{
+    record.append(&c, sizeof(c));
+}
+
+inline
+void format(Record &record, bool value)
+{
+    format(record, value ? "true" : "false");
+}
+
+inline
+void formatUInt(Record &record, uint64_t value, bool negative = false)
+{
+    char buf[24];
+    char *const end = buf + sizeof(buf);
+    char *begin = end;
+
+    do
+    {
+        *--begin = char('0' + value % 10);
+        value /= 10;
+    } while(value);
+
+    if(negative) *--begin = '-';
+    record.append(begin, std::size_t(end - begin));
+}
+
+template <typename T>
+typename std::enable_if<std::is_signed<T>::value>::type
+formatInt(Record &record, T value)
+{
+    /* negate in unsigned domain, avoids overflow for min() */
+    if(value < 0) formatUInt(record, ~uint64_t(int64_t(value)) + 1u, true);
+    else formatUInt(record, uint64_t(value));
+}
+
+template <typename T>
+typename std::enable_if<std::is_unsigned<T>::value>::type
+formatInt(Record &record, T value)
+{
+    formatUInt(record, uint64_t(value));
+}
+
+template <typename T>
+typename std::enable_if<
+    std::is_integral<T>::value
+    && !std::is_same<T, bool>::value
+    && !std::is_same<T, char>::value>::type
+format(Record &record, T value)
+{
+    formatInt(record, value);
+}
+
+template <typename T>
+typename std::enable_if<
+    !std::is_integral<T>::value
+    && !IsCallable<const T>::value>::type
+format(Record &record, const T &value)
+{
+    auto &oss = stream();
+    oss << value;
+    const auto str = oss.str();
+    record.append(str.data(), str.size());
+}
+
+/* lazy argument, evaluated only if record is emitted */
+template <typename T>
+typename std::enable_if<IsCallable<const T>::value>::type
+format(Record &record, const T &value)
+{
+    format(record, value());
+}
+
+inline
+void formatAll(Record &) {}
+
+template <typename T, typename ...Ts>
+void formatAll(Record &record, T &&value, Ts &&...values)
+{
+    format(record, std::forward<T>(value));
+    formatAll(record, std::forward<Ts>(values)...);
+}
+
+} /* detail */
+
+template <typename ...Ts>
+void trace(Level level, const char *file, int line, Ts &&...values)
+{
+    Record record;
+
+    record.timestamp = std::chrono::system_clock::now();
+    record.level = level;
+    record.truncated = false;
+    record.size = 0;
+
+    if(const char *base = std::strrchr(file, '/')) file = base + 1;
+
+    detail::format(record, file);
+    detail::format(record, ':');
+    detail::format(record, line);
+    detail::format(record, ' ');
+    detail::formatAll(record, std::forward<Ts>(values)...);
+    push(record);
+}
+
+} /* atrace */
+
+#define ATRACE(level, ...) \
+    do \
+    { \
+        if(atrace::compiled(level) && atrace::enabled(level)) \
+        { \
+            atrace::trace(level, __FILE__, __LINE__, __VA_ARGS__); \
+        } \
+    } while(false)
@@ -0,0 +1,63 @@
+#include <algorithm>
+#include <iterator>
+
+#include "Ensure.h"
+#include "checksum.h"
+
+#include "crc.h"
+
+namespace {
+
+void append(std::vector<uint8_t> &dst, const std::vector<uint8_t> &src)
+{
+    dst.insert(std::end(dst), std::begin(src), std::end(src));
+}
+
+} /* namespace */
+
+Checksum calcChecksum(image::RecordSeq seq)
+{
+    auto begin = std::begin(seq);
+
+    /* remove non-data segments */
+    while(begin != std::end(seq))
+    {
+        if(ihex::RecordType::Data != begin->type()) begin = seq.erase(begin);
+        else ++begin;
+    }
+
+    /* crc16 should be calculated based on fw data bytes from lower to higher
+     * addresses. Sort sequence to ensure ascending order */
+    std::sort(
+        std::begin(seq), std::end(seq),
+        [](const ihex::Record &x, const ihex::Record &y)
+        {return x.addr() < y.addr();});
+
+    std::vector<uint8_t> data;
+
+    begin = std::begin(seq);
+
+    while(std::end(seq) != begin)
+    {
+        append(data, begin->data());
+
+        if(std::begin(seq) != begin)
+        {
+            const auto prev = std::prev(begin);
+            const auto continuous = prev->addr() + prev->size() == begin->addr();
+            ENSURE(continuous, RuntimeError);
+        }
+        ++begin;
+    }
+
+    const auto crc = Modbus::RTU::calcCRC(data.data(), data.data() + data.size());
+    /* image without data records: crc of empty data, no pages */
+    const uint32_t addrBegin = seq.empty() ? 0 : seq.front().addr();
+
+    return
+    {
+        crc.highByte(), crc.lowByte(),
+        data.size(),
+        addrBegin, uint32_t(addrBegin + data.size())
+    };
+}
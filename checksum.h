@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "flash.h"
+#include "image.h"
+
+/* Modbus RTU crc16 of fw data bytes, from lower to higher addresses,
+ * data has to be continuous (empty image: crc of empty data, size 0) */
+
+struct Checksum
+{
+    uint8_t highByte;
+    uint8_t lowByte;
+    /* fw data bytes */
+    std::size_t size;
+    /* [addrBegin, addrEnd) */
+    uint32_t addrBegin;
+    uint32_t addrEnd;
+
+    /* number of flash pages covered by [addrBegin, addrEnd) */
+    uint32_t pageNum() const
+    {
+        const auto pageBegin = addrBegin / FLASH_PAGE_SIZE;
+        const auto pageEnd = (addrEnd + FLASH_PAGE_SIZE - 1) / FLASH_PAGE_SIZE;
+
+        return pageEnd - pageBegin;
+    }
+};
+
+Checksum calcChecksum(image::RecordSeq seq);
@@ -1,12 +1,17 @@
 #pragma once
 
+#include <algorithm>
 #include <cstdint>
 #include <iomanip>
 #include <iostream>
+#include <iterator>
 #include <vector>
 
 #include "Ensure.h"
 
+// flash page size 64 words (128 bytes)
+constexpr uint16_t FLASH_PAGE_SIZE = 128;
+
 class FlashPage
 {
     friend
@@ -19,7 +24,7 @@ class FlashPage
             << flashPage.size()
             << " (" << std::dec << flashPage.size() << ")";
 #if 0
-        for(const auto data : flashPage.data())
+        for(const auto data : flashPage)
         {
             os << std::hex << std::setw(2) << std::setfill('0') << int(data);
         }
@@ -29,31 +34,119 @@ class FlashPage
 
     std::size_t capacity_;
     uint16_t addr_;
-    std::vector<uint8_t> data_;
+    const uint8_t *data_;
+    std::size_t size_;
 public:
-    FlashPage(uint16_t capacity, uint16_t addr):
+    FlashPage(uint16_t capacity, uint16_t addr, const uint8_t *data, std::size_t size):
         capacity_{capacity},
-        addr_{addr}
+        addr_{addr},
+        data_{data},
+        size_{size}
     {}
 
-    void append(uint8_t byte)
+    std::size_t capacity() const {return capacity_;}
+    uint16_t addr() const {return addr_;}
+    std::size_t size() const {return size_;}
+    const uint8_t *data() const {return data_;}
+    const uint8_t *begin() const {return data_;}
+    const uint8_t *end() const {return data_ + size_;}
+};
+
+using FlashPageSeq = std::vector<FlashPage>;
+
+/* Whole fw image in single page aligned buffer (erased flash 0xFF),
+ * FlashPage is a view into it and is valid as long as FlashImage is.
+ *
+ * Pages are filled each from its first byte and a new page can be started
+ * only if previous one is full (last page can be partial), in any address
+ * order. Page started again is replaced (later data wins). pageSeq() is
+ * in ascending address order, pages which were not written are not part
+ * of it. */
+class FlashImage
+{
+    uint16_t pageSize_;
+    uint32_t addrBegin_;
+    std::vector<uint8_t> data_;
+    /* bytes written per page */
+    std::vector<uint16_t> fill_;
+    /* page being filled, fill_.size() if none */
+    std::size_t current_;
+
+    void fill(std::size_t page, std::size_t offset, std::size_t num)
+    {
+        if(0 == offset)
+        {
+            /* make sure prev. page is filled */
+            ENSURE(
+                fill_.size() == current_ || pageSize_ == fill_[current_],
+                RuntimeError);
+            fill_[page] = 0;
+            current_ = page;
+        }
+
+        /* data to be appended should belong to current flash page */
+        ENSURE(page == current_, RuntimeError);
+        ENSURE(offset == fill_[page], RuntimeError);
+        fill_[page] += num;
+    }
+public:
+    /* [addrBegin, addrEnd) is extended to page boundaries */
+    FlashImage(uint16_t pageSize, uint32_t addrBegin, uint32_t addrEnd):
+        pageSize_{pageSize},
+        addrBegin_{addrBegin - addrBegin % pageSize}
     {
-        ENSURE(capacity() > data_.size(), RuntimeError);
-        data_.push_back(byte);
+        ENSURE(0 < pageSize, RuntimeError);
+        ENSURE(addrBegin <= addrEnd, RuntimeError);
+
+        const auto pageNum = (addrEnd - addrBegin_ + pageSize - 1) / pageSize;
+
+        data_.assign(pageNum * pageSize, 0xFF);
+        fill_.assign(pageNum, 0);
+        current_ = fill_.size();
     }
 
-    template <typename I>
-    void append(I begin, const I end)
+    void write(uint32_t addr, const uint8_t *begin, const uint8_t *const end)
     {
-        const auto num = std::distance(begin, end);
+        auto num = std::size_t(std::distance(begin, end));
+
+        ENSURE(addrBegin_ <= addr, RuntimeError);
+        ENSURE(addr - addrBegin_ + num <= data_.size(), RuntimeError);
+
+        auto offset = std::size_t(addr - addrBegin_);
 
-        ENSURE(capacity() >= data_.size() + num, RuntimeError);
+        /* single copy, page bookkeeping is done per page not per byte */
+        std::copy(begin, end, std::next(std::begin(data_), offset));
 
-        data_.insert(std::end(data_), begin, end);
+        while(num)
+        {
+            const auto page = offset / pageSize_;
+            const auto pageOffset = offset % pageSize_;
+            const auto pageNum = std::min(num, pageSize_ - pageOffset);
+
+            fill(page, pageOffset, pageNum);
+            offset += pageNum;
+            num -= pageNum;
+        }
     }
 
-    std::size_t capacity() const {return capacity_;}
-    uint16_t addr() const {return addr_;}
-    std::size_t size() const {return data_.size();}
+    uint16_t pageSize() const {return pageSize_;}
+    uint32_t addrBegin() const {return addrBegin_;}
     const std::vector<uint8_t> &data() const {return data_;}
+
+    FlashPageSeq pageSeq() const
+    {
+        FlashPageSeq seq;
+
+        for(std::size_t page = 0; page < fill_.size(); ++page)
+        {
+            if(0 == fill_[page]) continue;
+
+            seq.emplace_back(
+                pageSize_,
+                uint16_t(addrBegin_ + page * pageSize_),
+                data_.data() + page * pageSize_,
+                fill_[page]);
+        }
+        return seq;
+    }
 };
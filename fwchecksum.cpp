@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <fstream>
 #include <iostream>
@@ -7,14 +8,15 @@
 #include <sstream>
 #include <thread>
 
+#include <dirent.h>
 #include <unistd.h>
 
-#include "Ensure.h"
-#include "Trace.h"
-#include "flash.h"
-#include "ihex.h"
+#include <nlohmann/json.hpp>
 
-#include "crc.h"
+#include "Ensure.h"
+#include "atrace.h"
+#include "checksum.h"
+#include "image.h"
 
 namespace {
 
@@ -24,110 +26,212 @@ void help(const char *argv0, const char *message = nullptr)
 
     std::cout
         << argv0
-        << " -f filename"
+        << " -f filename(.hex|.elf|.bin)"
+        << " [-o bin_base_addr]"
+        << '\n'
+        << argv0
+        << " [-f filename] [-d directory] [-m manifest] [filename ...]"
+        << " [-o bin_base_addr (.bin files only)]"
+        << " [-j jobs]"
+        << " [-c cache_file]"
         << std::endl;
 }
 
-using RecordSeq = std::vector<ihex::Record>;
+using RecordSeq = image::RecordSeq;
+
+using json = nlohmann::json;
+
+/* 64bit FNV-1a, identifies file content in result cache */
+uint64_t calcContentHash(const std::vector<uint8_t> &data)
+{
+    uint64_t hash = 0xcbf29ce484222325;
+
+    for(const auto c : data)
+    {
+        hash ^= c;
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
 
-RecordSeq parseRecordSeq(std::istream &file)
+std::string toHex(uint64_t value)
 {
-    ENSURE(file, RuntimeError);
+    std::ostringstream oss;
 
-    file >> std::noskipws;
+    oss << std::hex << std::setw(16) << std::setfill('0') << value;
+    return oss.str();
+}
 
-    std::string fileData
+json toJson(const Checksum &checksum)
+{
+    return
     {
-        std::istream_iterator<char>{file},
-        std::istream_iterator<char>{}
+        {"crc", std::vector<uint8_t>{checksum.highByte, checksum.lowByte}},
+        {"size", checksum.size},
+        {"addr_begin", checksum.addrBegin},
+        {"addr_end", checksum.addrEnd},
+        {"pages", checksum.pageNum()}
     };
+}
 
-    auto curr = std::begin(fileData);
-    const auto end = std::end(fileData);
-    RecordSeq seq;
+using FileNameSeq = std::vector<std::string>;
 
-    while(curr != end)
+bool isImageName(const std::string &name)
+{
+    for(const std::string ext : {".hex", ".elf", ".bin"})
     {
-        if('\n' == *curr)
+        if(
+            name.size() > ext.size()
+            && 0 == name.compare(name.size() - ext.size(), ext.size(), ext))
         {
-            std::advance(curr, 1);
-            continue;
+            return true;
         }
-
-        auto i = std::find_if(curr, end, [](char c){return '\n' == c;});
-
-        seq.push_back(ihex::parseRecord(curr, i));
-        curr = i;
     }
-    return seq;
+    return false;
 }
 
-void append(std::vector<uint8_t> &dst, const std::vector<uint8_t> &src)
+void appendDirectory(FileNameSeq &seq, const std::string &dirName)
 {
-    dst.insert(std::end(dst), std::begin(src), std::end(src));
-}
+    auto dir = ::opendir(dirName.c_str());
 
-void dump(std::ostream &os, uint8_t data)
-{
-    os << "0x" << std::hex << std::setw(2) << std::setfill('0') << int(data);
-}
+    ENSURE(dir, RuntimeError);
 
-void dump(std::ostream &os, const uint8_t *begin, const uint8_t *const end)
-{
-    const auto flags = os.flags();
-    int cntr = 0;
+    FileNameSeq dirSeq;
 
-    while(begin != end)
+    while(const auto entry = ::readdir(dir))
     {
-        dump(os, *begin);
-        ++begin;
-        ++cntr;
-        os << ' ';
+        const std::string name{entry->d_name};
 
-        if(0 == (cntr % 16)) os << '\n';
+        if(isImageName(name)) dirSeq.push_back(dirName + '/' + name);
     }
-    os << '\n';
-    os.flags(flags);
+    ::closedir(dir);
+
+    std::sort(std::begin(dirSeq), std::end(dirSeq));
+    seq.insert(std::end(seq), std::begin(dirSeq), std::end(dirSeq));
 }
 
-Modbus::RTU::CRC calcChecksum(RecordSeq seq)
+/* one file name per line, empty lines and lines starting with '#' are skipped */
+void appendManifest(FileNameSeq &seq, const std::string &manifestName)
 {
-    auto begin = std::begin(seq);
+    std::ifstream manifest{manifestName};
 
-    /* remove non-data segments */
-    while(begin != std::end(seq))
+    ENSURE(manifest, RuntimeError);
+
+    for(std::string line; std::getline(manifest, line);)
     {
-        if(ihex::RecordType::Data != begin->type()) begin = seq.erase(begin);
-        else ++begin;
+        if(line.empty() || '#' == line[0]) continue;
+        seq.push_back(line);
     }
+}
+
+/* cache: content hash -> result (without file name) */
+json loadCache(const std::string &cacheName)
+{
+    std::ifstream cache{cacheName};
 
-    /* crc16 should be calculated based on fw data bytes from lower to higher
-     * addresses. Sort sequence to ensure ascending order */
-    std::sort(
-        std::begin(seq), std::end(seq),
-        [](const ihex::Record &x, const ihex::Record &y)
-        {return x.addr() < y.addr();});
+    if(!cache) return json::object();
 
-    std::vector<uint8_t> data;
+    auto data = json::parse(cache, nullptr, false);
 
-    begin = std::begin(seq);
+    return data.is_object() ? data : json::object();
+}
 
-    while(std::end(seq) != begin)
-    {
-        append(data, begin->data());
+void storeCache(const std::string &cacheName, const json &data)
+{
+    std::ofstream cache{cacheName, std::ios::trunc};
+
+    ENSURE(cache, RuntimeError);
+    cache << data.dump() << '\n';
+}
 
-        if(std::begin(seq) != begin)
+json batch(
+    const FileNameSeq &fileNameSeq,
+    int32_t baseAddr,
+    unsigned jobNum,
+    const std::string &cacheName)
+{
+    auto cache = cacheName.empty() ? json::object() : loadCache(cacheName);
+    std::vector<json> resultSeq(fileNameSeq.size());
+    std::vector<std::string> keySeq(fileNameSeq.size());
+    std::atomic<std::size_t> next{0};
+
+    /* cache is only read by workers, updated once all of them are done */
+    auto worker =
+        [&]()
         {
-            const auto prev = std::prev(begin);
-            const auto continuous = prev->addr() + prev->size() == begin->addr();
-            ENSURE(continuous, RuntimeError);
+            for(
+                auto i = next.fetch_add(1);
+                i < fileNameSeq.size();
+                i = next.fetch_add(1))
+            {
+                const auto &fileName = fileNameSeq[i];
+                auto &result = resultSeq[i];
+
+                try
+                {
+                    auto data = image::readFile(fileName);
+                    const auto format = image::toFormat(fileName);
+                    auto &key = keySeq[i];
+
+                    key = toHex(calcContentHash(data));
+                    /* same binary content at other base address differs */
+                    if(image::Format::Bin == format)
+                    {
+                        key +=
+                            ':' + std::to_string(
+                                image::NO_BASE_ADDR == baseAddr ? 0 : baseAddr);
+                    }
+
+                    const auto cached = cache.find(key);
+
+                    if(std::end(cache) != cached)
+                    {
+                        result = *cached;
+                        key.clear();
+                    }
+                    else
+                    {
+                        /* other formats carry their own addresses */
+                        const auto fileBaseAddr =
+                            image::Format::Bin == format ? baseAddr : image::NO_BASE_ADDR;
+
+                        result =
+                            toJson(
+                                calcChecksum(
+                                    image::parse(std::move(data), format, fileBaseAddr)));
+                    }
+                }
+                catch(const std::exception &except)
+                {
+                    result = {{"error", except.what()}};
+                    keySeq[i].clear();
+                }
+                result["file"] = fileName;
+            }
+        };
+
+    std::vector<std::thread> workerSeq;
+
+    jobNum = std::max(1u, std::min(jobNum, unsigned(fileNameSeq.size())));
+
+    for(unsigned i = 0; i < jobNum; ++i) workerSeq.emplace_back(worker);
+    for(auto &thread : workerSeq) thread.join();
+
+    if(!cacheName.empty())
+    {
+        for(std::size_t i = 0; i < resultSeq.size(); ++i)
+        {
+            if(keySeq[i].empty()) continue;
+
+            auto entry = resultSeq[i];
+
+            entry.erase("file");
+            cache[keySeq[i]] = std::move(entry);
         }
-        ++begin;
+        storeCache(cacheName, cache);
     }
 
-    //dump(std::cout, data.data(), data.data() + data.size());
-
-    return Modbus::RTU::calcCRC(data.data(), data.data() + data.size());
+    return json(resultSeq);
 }
 
 } /* namespace */
@@ -135,8 +239,13 @@ Modbus::RTU::CRC calcChecksum(RecordSeq seq)
 int main(int argc, char *const argv[])
 {
     std::string fileName;
+    std::string dirName;
+    std::string manifestName;
+    std::string cacheName;
+    long baseAddr = image::NO_BASE_ADDR;
+    int jobNum = int(std::max(1u, std::thread::hardware_concurrency()));
 
-    for(int c; -1 != (c = ::getopt(argc, argv, "hf:"));)
+    for(int c; -1 != (c = ::getopt(argc, argv, "hf:o:d:m:j:c:"));)
     {
         switch(c)
         {
@@ -147,6 +256,21 @@ int main(int argc, char *const argv[])
             case 'f':
                 fileName = optarg ? optarg : "";
                 break;
+            case 'o':
+                baseAddr = optarg ? ::strtol(optarg, nullptr, 0) : -1;
+                break;
+            case 'd':
+                dirName = optarg ? optarg : "";
+                break;
+            case 'm':
+                manifestName = optarg ? optarg : "";
+                break;
+            case 'j':
+                jobNum = optarg ? ::atoi(optarg) : -1;
+                break;
+            case 'c':
+                cacheName = optarg ? optarg : "";
+                break;
             case ':':
             case '?':
             default:
@@ -156,39 +280,77 @@ int main(int argc, char *const argv[])
         }
     }
 
-    if(fileName.empty())
+    const bool batchMode =
+        optind < argc
+        || !dirName.empty()
+        || !manifestName.empty();
+
+    if(
+        (fileName.empty() && !batchMode)
+        || (image::NO_BASE_ADDR != baseAddr && (baseAddr < 0 || baseAddr > 0xFFFF))
+        || jobNum < 1)
     {
         help(argv[0], "missing/invalid required arguments");
         return EXIT_FAILURE;
     }
 
+    if(
+        !batchMode
+        && image::NO_BASE_ADDR != baseAddr
+        && image::Format::Bin != image::toFormat(fileName))
+    {
+        help(argv[0], "-o applies to .bin only");
+        return EXIT_FAILURE;
+    }
+
     try
     {
-        std::ifstream file{fileName};
-        const auto checksum = calcChecksum(parseRecordSeq(file));
+        if(batchMode)
+        {
+            FileNameSeq fileNameSeq;
+
+            if(!fileName.empty()) fileNameSeq.push_back(fileName);
+            for(int i = optind; i < argc; ++i) fileNameSeq.push_back(argv[i]);
+            if(!dirName.empty()) appendDirectory(fileNameSeq, dirName);
+            if(!manifestName.empty()) appendManifest(fileNameSeq, manifestName);
+
+            const auto resultSeq =
+                batch(fileNameSeq, int32_t(baseAddr), unsigned(jobNum), cacheName);
+
+            std::cout << resultSeq.dump(2) << std::endl;
+
+            const auto failed =
+                std::any_of(
+                    std::begin(resultSeq), std::end(resultSeq),
+                    [](const json &result){return result.count("error");});
+
+            return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+        }
+
+        const auto checksum = calcChecksum(image::load(fileName, int32_t(baseAddr)));
 
         std::ostringstream oss;
 
         oss
             << "HEX 0x"
-            << std::hex << std::setw(2) << std::setfill('0') << int(checksum.highByte())
+            << std::hex << std::setw(2) << std::setfill('0') << int(checksum.highByte)
             << ",0x"
-            << std::hex << std::setw(2) << std::setfill('0') << int(checksum.lowByte())
+            << std::hex << std::setw(2) << std::setfill('0') << int(checksum.lowByte)
             << ", DEC "
-            << std::dec << int(checksum.highByte())
+            << std::dec << int(checksum.highByte)
             << ','
-            << std::dec << int(checksum.lowByte());
+            << std::dec << int(checksum.lowByte);
 
-        TRACE(TraceLevel::Info, "checksum ", oss.str());
+        ATRACE(atrace::Level::Info, "checksum ", oss.str());
     }
     catch(const std::exception &except)
     {
-        TRACE(TraceLevel::Error, except.what());
+        ATRACE(atrace::Level::Error, except.what());
         return EXIT_FAILURE;
     }
     catch(...)
     {
-        TRACE(TraceLevel::Error, "unsupported exception");
+        ATRACE(atrace::Level::Error, "unsupported exception");
         return EXIT_FAILURE;
     }
 
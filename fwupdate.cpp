@@ -1,9 +1,13 @@
 #include <algorithm>
+#include <atomic>
 #include <chrono>
-#include <fstream>
+#include <cstring>
+#include <functional>
 #include <iostream>
 #include <iterator>
 #include <limits>
+#include <memory>
+#include <numeric>
 #include <sstream>
 #include <thread>
 
@@ -13,9 +17,14 @@
 
 #include "Client.h"
 #include "Ensure.h"
-#include "Trace.h"
+#include "atrace.h"
+#include "checksum.h"
 #include "flash.h"
 #include "ihex.h"
+#include "image.h"
+#include "rtt.h"
+#include "session.h"
+#include "throttle.h"
 
 namespace {
 
@@ -68,100 +77,87 @@ void help(const char *argv0, const char *message = nullptr)
         << argv0
         << " -a broker_address"
         << " -s service_name"
-        << " -f filename"
-        << " -t slaveID"
+        << " -f filename(.hex|.elf|.bin)"
+        << " [-o bin_base_addr]"
+        << " -t slaveID|first-last [-t ...]"
+        << " [-b broadcast_settle_ms [-c crc_register_addr]]"
+        << " [-r max_bus_bytes_per_sec]"
+        << " [-u max_bus_share_percent]"
+        << " [-y (low priority, wait while service is busy)]"
+        << " [-w capture_file | -p replay_file [-P replay_time_scale]]"
+        << " [-l trace_level(0-3)]"
+        << '\n'
+        << argv0
+        << " -x (scan)"
+        << " -a broker_address"
+        << " -s service_name [-s service_name ...]"
+        << " -f filename(.hex|.elf|.bin)"
+        << " [-o bin_base_addr]"
+        << " -t slaveID|first-last [-t ...]"
+        << " [-c crc_register_addr (without it no device is skipped)]"
+        << " [-j jobs]"
+        << " [-w capture_file | -p replay_file [-P replay_time_scale]]"
+        << " [-l trace_level(0-3)]"
+        << '\n'
+        << argv0
+        << " -n (dry run)"
+        << " [-s service_name ...]"
+        << " -f filename(.hex|.elf|.bin)"
+        << " [-o bin_base_addr]"
+        << " -t slaveID|first-last [-t ...]"
+        << " [-b broadcast_settle_ms [-c crc_register_addr]]"
+        << " [-r max_bus_bytes_per_sec]"
+        << " [-u max_bus_share_percent]"
+        << " [-y (low priority)]"
+        << " [-R baud_rate]"
+        << " [-T broker_rtt_ms | -p capture_file (measured broker rtt)]"
+        << " [-W page_write_ms]"
         << std::endl;
 }
 
-using RecordSeq = std::vector<ihex::Record>;
-using FlashPageSeq = std::vector<FlashPage>;
-
-RecordSeq parseRecordSeq(std::istream &file)
+using RecordSeq = image::RecordSeq;
+FlashImage toFlashImage(
+    RecordSeq::const_iterator recordBegin,
+    RecordSeq::const_iterator recordEnd)
 {
-    ENSURE(file, RuntimeError);
-
-    file >> std::noskipws;
+    const auto isData =
+        [](const ihex::Record &record)
+        {return ihex::RecordType::Data == record.type();};
+    const auto isEndOfFile =
+        [](const ihex::Record &record)
+        {return ihex::RecordType::EndOfFile == record.type();};
 
-    std::string fileData
-    {
-        std::istream_iterator<char>{file},
-        std::istream_iterator<char>{}
-    };
+    recordEnd = std::find_if(recordBegin, recordEnd, isEndOfFile);
 
-    auto curr = std::begin(fileData);
-    const auto end = std::end(fileData);
-    RecordSeq seq;
+    /* image address range, single allocation for all pages */
+    uint32_t addrBegin = std::numeric_limits<uint32_t>::max();
+    uint32_t addrEnd = 0;
 
-    while(curr != end)
+    for(auto currRecord = recordBegin; currRecord != recordEnd; ++currRecord)
     {
-        if('\n' == *curr)
+        if(!isData(*currRecord))
         {
-            std::advance(curr, 1);
+            ATRACE(atrace::Level::Warning, "skipped ", *currRecord);
             continue;
         }
-
-        auto i = std::find_if(curr, end, [](char c){return '\n' == c;});
-
-        seq.push_back(ihex::parseRecord(curr, i));
-        curr = i;
+        addrBegin = std::min(addrBegin, uint32_t(currRecord->addr()));
+        addrEnd = std::max(addrEnd, uint32_t(currRecord->addr() + currRecord->size()));
     }
-    return seq;
-}
 
-FlashPageSeq toFlashPageSeq(
-    RecordSeq::const_iterator recordBegin,
-    const RecordSeq::const_iterator recordEnd)
-{
-    // flash page size 64 words (128 bytes)
-    const uint16_t flashPageSize = 128;
-    FlashPageSeq flashPageSeq;
+    /* no data records (e.g. EOF only), no pages */
+    if(addrBegin > addrEnd) return FlashImage{FLASH_PAGE_SIZE, 0, 0};
+
+    FlashImage flashImage{FLASH_PAGE_SIZE, addrBegin, addrEnd};
 
     for(auto currRecord = recordBegin; currRecord != recordEnd; ++currRecord)
     {
-        if(ihex::RecordType::EndOfFile == currRecord->type()) break;
-        if(ihex::RecordType::Data != currRecord->type())
-        {
-            TRACE(TraceLevel::Warning, "skipped ", *currRecord);
-            continue;
-        }
-
-        const auto dataBegin = std::begin(currRecord->data());
-        const auto dataEnd = std::end(currRecord->data());
-        auto dataCurr = dataBegin;
-
-        while(dataCurr != dataEnd)
-        {
-            const auto offset = std::size_t(std::distance(dataBegin, dataCurr));
-
-            if(uint16_t{0} == ((currRecord->addr() + offset) % flashPageSize))
-            {
-                if(!flashPageSeq.empty())
-                {
-                    /* make sure prev. page is filled */
-                    ENSURE(
-                        flashPageSeq.back().capacity() == flashPageSeq.back().size(),
-                        RuntimeError);
-                }
+        if(!isData(*currRecord)) continue;
 
-                flashPageSeq.emplace_back(flashPageSize, currRecord->addr() + offset);
-            }
-
-            ENSURE(!flashPageSeq.empty(), RuntimeError);
-
-            auto &currFlashPage = flashPageSeq.back();
-            /* data to be appended should belong to current flash page */
-            ENSURE(
-                currFlashPage.addr() <= currRecord->addr() + offset,
-                RuntimeError);
-            ENSURE(
-                currFlashPage.addr() + currFlashPage.capacity() > currRecord->addr() + offset,
-                RuntimeError);
+        const auto &data = currRecord->data();
 
-            currFlashPage.append(*dataCurr);
-            ++dataCurr;
-        }
+        flashImage.write(currRecord->addr(), data.data(), data.data() + data.size());
     }
-    return flashPageSeq;
+    return flashImage;
 }
 
 constexpr const uint16_t RTU_ADDR_BASE{0x2000};
@@ -188,10 +184,40 @@ json toModbusRequest(const FlashPage &flashPage, uint8_t slaveID)
         {
             {SLAVE, slaveID},
             {FCODE, FCODE_WR_BYTES},
-            {TIMEOUT_MS, 1000},
             {ADDR, RTU_ADDR_BASE + 8},
             {COUNT, flashPage.size()},
-            {VALUE, flashPage.data()}
+            {VALUE, std::vector<uint8_t>(flashPage.begin(), flashPage.end())}
+        }
+    };
+
+    return req;
+}
+
+json toFlagsRequest(uint8_t slaveID, uint8_t flags)
+{
+    json req
+    {
+        {
+            {SLAVE, slaveID},
+            {FCODE, FCODE_WR_BYTES},
+            {ADDR, RTU_ADDR_BASE + 0},
+            {COUNT, 1},
+            {VALUE,  std::vector<uint8_t>{flags}}
+        }
+    };
+
+    return req;
+}
+
+json toReadRequest(uint8_t slaveID, uint16_t addr, uint8_t count)
+{
+    json req
+    {
+        {
+            {SLAVE, slaveID},
+            {FCODE, FCODE_RD_BYTES},
+            {ADDR, addr},
+            {COUNT, count}
         }
     };
 
@@ -207,57 +233,233 @@ void validateReply(const json &request, const json &reply)
     ENSURE(request[0][SLAVE] == reply[0][SLAVE], RuntimeError);
 }
 
-void handleFlashPageFill(
-    const std::string &brokerAddress,
-    const std::string &serviceName,
-    uint8_t slaveID,
-    const FlashPage &flashPage)
+/* Modbus broadcast address, request is executed by all slaves on the bus
+ * but none of them replies. modbus_mdp is expected to transmit broadcast
+ * request without waiting for a reply (timeout_ms 0) and to answer with
+ * statusSucess and the request echoed back (no slave data) */
+constexpr uint8_t BROADCAST_SLAVE_ID = 0;
+constexpr int BROADCAST_TIMEOUT_MS = 0;
+
+RttTable &rttTable()
 {
-    auto request = toModbusRequest(flashPage, slaveID);
-    auto requestPayload = std::string{request.dump()};
+    static RttTable table;
+    return table;
+}
 
-    TRACE(TraceLevel::Debug, flashPage, " ", requestPayload);
+/* requests of same shape (fcode/count of each transaction) share estimator */
+RttTable::Key toRttKey(const std::string &serviceName, const json &request)
+{
+    std::string shape;
 
-    Client client;
+    for(const auto &transaction : request)
+    {
+        if(!shape.empty()) shape += ',';
+        shape += std::to_string(transaction[FCODE].get<int>());
+        shape += '/';
+        shape += std::to_string(transaction[COUNT].get<int>());
+    }
+    return RttTable::Key{serviceName, request[0][SLAVE].get<uint8_t>(), shape};
+}
 
-    const auto replyPayload =
-        client.exec(brokerAddress, serviceName, {std::move(requestPayload)});
+Throttle &throttle()
+{
+    static Throttle throttle;
+    return throttle;
+}
+
+/* Modbus RTU bytes on the bus, each frame: slave, fcode, addr (2), count,
+ * data, crc (2). Write request and read reply carry data, broadcast is
+ * not replied */
+uint32_t toBusBytes(const json &request)
+{
+    constexpr uint32_t frameOverhead = 7;
+    uint32_t bytes = 0;
 
-    ENSURE(2 == int(replyPayload.size()), RuntimeError);
-    ENSURE(MDP::Broker::Signature::statusSucess == replyPayload[0], RuntimeError);
+    for(const auto &transaction : request)
+    {
+        const auto count = transaction[COUNT].get<uint32_t>();
+        const bool write = FCODE_WR_BYTES == transaction[FCODE];
+
+        bytes += frameOverhead + (write ? count : 0);
+
+        if(BROADCAST_SLAVE_ID != transaction[SLAVE])
+        {
+            bytes += frameOverhead + (write ? 0 : count);
+        }
+    }
+    return bytes;
+}
 
-    validateReply(request, json::parse(replyPayload.back()));
+std::unique_ptr<session::Recorder> &recorder()
+{
+    static std::unique_ptr<session::Recorder> recorder;
+    return recorder;
 }
 
-void handleFlashPageUpdate(
+std::unique_ptr<session::Replay> &replay()
+{
+    static std::unique_ptr<session::Replay> replay;
+    return replay;
+}
+
+json withoutTimeout(json request)
+{
+    for(auto &transaction : request) transaction.erase(TIMEOUT_MS);
+    return request;
+}
+
+/* Client::exec, recorded or replayed if enabled */
+session::FrameSeq send(
+    Client &client,
     const std::string &brokerAddress,
     const std::string &serviceName,
-    uint8_t slaveID)
+    const json &request,
+    const std::string &requestPayload)
 {
-    json request
+    using session::Clock;
+
+    if(replay())
     {
+        /* recorded requests are stripped of timeout_ms on load */
+        const auto key = withoutTimeout(request);
+        const auto entry =
+            replay()->take(
+                [&](const session::Entry &recorded)
+                {
+                    return serviceName == recorded.service && key == recorded.request;
+                });
+
+        if(!entry.error.empty()) throw std::runtime_error{entry.error};
+        return entry.reply;
+    }
+
+    const auto begin = Clock::now();
+
+    try
+    {
+        const auto payload = client.exec(brokerAddress, serviceName, {requestPayload});
+        const session::FrameSeq reply{std::begin(payload), std::end(payload)};
+
+        if(recorder())
         {
-            {SLAVE, slaveID},
-            {FCODE, FCODE_WR_BYTES},
-            {ADDR, RTU_ADDR_BASE + 0},
-            {COUNT, 1},
-            {VALUE,  std::vector<uint8_t>{FLAG_FLASH_PAGE_UPDATE}}
+            recorder()->record(begin, Clock::now(), serviceName, requestPayload, reply);
         }
-    };
+        return reply;
+    }
+    catch(const std::exception &except)
+    {
+        if(recorder())
+        {
+            recorder()->record(
+                begin, Clock::now(), serviceName, requestPayload, {}, except.what());
+        }
+        throw;
+    }
+}
+
+json exec(
+    const std::string &brokerAddress,
+    const std::string &serviceName,
+    json request)
+{
+    using namespace std::chrono;
 
-    auto requestPayload = std::string{request.dump()};
+    const auto rttKey = toRttKey(serviceName, request);
+    /* broadcast has no round trip, its duration is not a sample of it */
+    const bool broadcast = BROADCAST_SLAVE_ID == request[0][SLAVE];
+    const auto timeout =
+        broadcast
+        ? milliseconds{BROADCAST_TIMEOUT_MS}
+        : duration_cast<milliseconds>(rttTable().get(rttKey).timeout());
 
-    TRACE(TraceLevel::Debug, requestPayload);
+    /* timeout is estimated for whole request, so it bounds each
+     * transaction of the request as well */
+    for(auto &transaction : request) transaction[TIMEOUT_MS] = timeout.count();
 
-    Client client;
+    const auto requestPayload = std::string{request.dump()};
+
+    ATRACE(atrace::Level::Debug, requestPayload);
+
+    throttle().acquire(toBusBytes(request));
 
+    /* client setup is not part of round trip */
+    Client client;
+    const auto begin = steady_clock::now();
     const auto replyPayload =
-        client.exec(brokerAddress, serviceName, {std::move(requestPayload)});
+        [&]()
+        {
+            try
+            {
+                auto payload =
+                    send(client, brokerAddress, serviceName, request, requestPayload);
+
+                ENSURE(2 == int(payload.size()), RuntimeError);
+                ENSURE(MDP::Broker::Signature::statusSucess == payload[0], RuntimeError);
+                return payload;
+            }
+            catch(...)
+            {
+                if(!broadcast) rttTable().backoff(rttKey);
+                throw;
+            }
+        }();
+
+    const auto rtt = duration_cast<RttEstimator::Duration>(steady_clock::now() - begin);
+
+    if(!broadcast) rttTable().update(rttKey, rtt);
+    throttle().release(rttKey, rtt);
+    ATRACE(
+        atrace::Level::Debug,
+        "rtt ", rtt.count(), "us timeout ", timeout.count(), "ms");
+
+    /* there is no slave reply to validate for broadcast */
+    if(broadcast) return json{};
+
+    auto reply = json::parse(replyPayload.back());
+
+    validateReply(request, reply);
+    return reply;
+}
+
+void handleFlashPageFill(
+    const std::string &brokerAddress,
+    const std::string &serviceName,
+    uint8_t slaveID,
+    const FlashPage &flashPage)
+{
+    ATRACE(atrace::Level::Debug, flashPage);
+    exec(brokerAddress, serviceName, toModbusRequest(flashPage, slaveID));
+}
+
+void handleFlashPageUpdate(
+    const std::string &brokerAddress,
+    const std::string &serviceName,
+    uint8_t slaveID)
+{
+    exec(brokerAddress, serviceName, toFlagsRequest(slaveID, FLAG_FLASH_PAGE_UPDATE));
+}
 
-    ENSURE(2 == int(replyPayload.size()), RuntimeError);
-    ENSURE(MDP::Broker::Signature::statusSucess == replyPayload[0], RuntimeError);
+std::vector<uint8_t> fetchBytes(
+    const std::string &brokerAddress,
+    const std::string &serviceName,
+    uint8_t slaveID,
+    uint16_t addr,
+    uint8_t count)
+{
+    const auto reply =
+        exec(brokerAddress, serviceName, toReadRequest(slaveID, addr, count));
+
+    ENSURE(reply[0][VALUE].is_array(), RuntimeError);
+    ENSURE(count == reply[0][VALUE].size(), RuntimeError);
 
-    validateReply(request, json::parse(replyPayload.back()));
+    std::vector<uint8_t> data;
+
+    for(const auto &value : reply[0][VALUE])
+    {
+        ENSURE(inRange<uint8_t>(value.get<int>()), RuntimeError);
+        data.push_back(uint8_t(value.get<int>()));
+    }
+    return data;
 }
 
 uint16_t fetchFlashPageWrNum(
@@ -265,152 +467,761 @@ uint16_t fetchFlashPageWrNum(
     const std::string &serviceName,
     uint8_t slaveID)
 {
-    json request
+    const auto data =
+        fetchBytes(brokerAddress, serviceName, slaveID, RTU_ADDR_BASE + 2, 2);
+
+    /* flash_page_wr_num is uint16_t little-endian */
+    return uint16_t((data[1] << 8) | data[0]);
+}
+
+/* between flash pages: while service looks busy (low priority only) back
+ * off, probing it with page write counter read to re-check queueing delay,
+ * proceed anyway after Throttle::maxYield() */
+void yieldWhileBusy(
+    const std::string &brokerAddress,
+    const std::string &serviceName,
+    uint8_t slaveID)
+{
+    const auto begin = Throttle::Clock::now();
+
+    for(
+        auto wait = throttle().backoff();
+        0 < wait.count();
+        wait = throttle().backoff())
     {
+        if(Throttle::maxYield() <= Throttle::Clock::now() - begin)
         {
-            {SLAVE, slaveID},
-            {FCODE, FCODE_RD_BYTES},
-            {ADDR, RTU_ADDR_BASE + 2},
-            {COUNT, 2}
+            ATRACE(atrace::Level::Info, "service busy, yield limit reached");
+            return;
         }
-    };
 
-    auto requestPayload = std::string{request.dump()};
+        ATRACE(atrace::Level::Debug, "service busy, yield ", wait.count(), "us");
+        std::this_thread::sleep_for(wait);
+        fetchFlashPageWrNum(brokerAddress, serviceName, slaveID);
+    }
+}
 
-    TRACE(TraceLevel::Debug, requestPayload);
+void handleWatchdogReset(
+    const std::string &brokerAddress,
+    const std::string &serviceName,
+    uint8_t slaveID)
+{
+    exec(brokerAddress, serviceName, toFlagsRequest(slaveID, FLAG_WATCHDOG_RESET));
+}
 
-    Client client;
+void handleReboot(
+    const std::string &brokerAddress,
+    const std::string &serviceName,
+    uint8_t slaveID)
+{
+    exec(brokerAddress, serviceName, toFlagsRequest(slaveID, FLAG_REBOOT));
+}
 
-    const auto replyPayload =
-        client.exec(brokerAddress, serviceName, {std::move(requestPayload)});
+using SlaveIDSeq = std::vector<uint8_t>;
 
-    ENSURE(2 == int(replyPayload.size()), RuntimeError);
-    ENSURE(MDP::Broker::Signature::statusSucess == replyPayload[0], RuntimeError);
+/* time required by slave to write flash page */
+constexpr std::chrono::milliseconds flashPageWrDelay{250};
 
-    const auto reply = json::parse(replyPayload.back());
+void flashPageUnicast(
+    const std::string &brokerAddress,
+    const std::string &serviceName,
+    uint8_t slaveID,
+    uint16_t flashPageUpdatedNum,
+    const FlashPage &flashPage)
+{
+    ENSURE(
+        flashPageUpdatedNum
+        == fetchFlashPageWrNum(brokerAddress, serviceName, slaveID),
+        RuntimeError);
+
+    handleWatchdogReset(brokerAddress, serviceName, slaveID);
+    handleFlashPageFill(brokerAddress, serviceName, slaveID, flashPage);
+    handleFlashPageUpdate(brokerAddress, serviceName, slaveID);
+    std::this_thread::sleep_for(flashPageWrDelay);
+}
 
-    validateReply(request, reply);
+void firmwareUpdateUnicast(
+    const FlashPageSeq &flashPageSeq,
+    const std::string &brokerAddress,
+    const std::string &serviceName,
+    uint8_t slaveID)
+{
+    uint16_t flashPageUpdatedNum = 0;
 
-    ENSURE(reply[0][VALUE].is_array(), RuntimeError);
-    ENSURE(2 == reply[0][VALUE].size(), RuntimeError);
+    ATRACE(atrace::Level::Info, "slave ", slaveID);
 
-    const auto lowByteValue = reply[0][VALUE][0].get<int>();
-    const auto highByteValue = reply[0][VALUE][1].get<int>();
+    for(const auto &flashPage : flashPageSeq)
+    {
+        yieldWhileBusy(brokerAddress, serviceName, slaveID);
+        ATRACE(atrace::Level::Info, "flashing page[", flashPageUpdatedNum, "] ", flashPage);
 
-    ENSURE(inRange<uint8_t>(lowByteValue), RuntimeError);
-    ENSURE(inRange<uint8_t>(highByteValue), RuntimeError);
+        try
+        {
+            flashPageUnicast(
+                brokerAddress, serviceName, slaveID,
+                flashPageUpdatedNum, flashPage);
+            ++flashPageUpdatedNum;
+        }
+        catch(std::exception &except)
+        {
+            /* TODO: impl. retry & recovery */
+            ATRACE(
+                atrace::Level::Error,
+                except.what(),
+                " while flashing ", flashPage);
+            throw;
+        }
+    }
 
-    return uint16_t((highByteValue << 8) | lowByteValue);
+    ATRACE(atrace::Level::Info, "rebooting");
+    handleReboot(brokerAddress, serviceName, slaveID);
 }
 
-void handleWatchdogReset(
+struct FlashPageStatus
+{
+    uint16_t wrNum;
+    /* latched by last flash_page_addr write */
+    uint16_t addr;
+};
+
+FlashPageStatus fetchFlashPageStatus(
     const std::string &brokerAddress,
     const std::string &serviceName,
     uint8_t slaveID)
 {
-    json request
+    /* flash_page_wr_num (+2) and flash_page_addr (+6) in single request */
+    const auto data =
+        fetchBytes(brokerAddress, serviceName, slaveID, RTU_ADDR_BASE + 2, 6);
+
+    /* both are uint16_t little-endian */
+    return
     {
+        uint16_t((data[1] << 8) | data[0]),
+        uint16_t((data[5] << 8) | data[4])
+    };
+}
+
+bool crcMatch(
+    const std::string &brokerAddress,
+    const std::string &serviceName,
+    uint8_t slaveID,
+    const Checksum &checksum,
+    uint16_t crcAddr)
+{
+    const auto crc = fetchBytes(brokerAddress, serviceName, slaveID, crcAddr, 2);
+
+    return crc == std::vector<uint8_t>{checksum.highByte, checksum.lowByte};
+}
+
+/* Identical slaves sharing one bus:
+ * - page address, data and commit are broadcast once, followed by settle
+ *   delay (no slave replies to broadcast)
+ * - each slave page write counter and latched page address are queried:
+ *   - counter not incremented: page missed, unicast re-send
+ *   - counter incremented at other address: page address write was missed
+ *     and page data was written at stale (previous page) address, that
+ *     page is restored and current page re-sent with unicast requests
+ * - after last page each slave page write counter is verified and if crc
+ *   register is configured, flashed content against image crc (a missed
+ *   page data write leaves counter and address intact), on mismatch whole
+ *   image is re-sent to that slave with unicast requests
+ * - slave which fails any of the above is dropped, the others are updated
+ *   and rebooted, update fails at the end listing dropped slaves */
+void firmwareUpdateBroadcast(
+    const FlashPageSeq &flashPageSeq,
+    const std::string &brokerAddress,
+    const std::string &serviceName,
+    const SlaveIDSeq &slaveIDSeq,
+    std::chrono::milliseconds settleDelay,
+    const Checksum &checksum,
+    int crcAddr)
+{
+    struct Slave
+    {
+        uint8_t id;
+        /* pages written, including unicast re-sends */
+        uint16_t wrNum;
+    };
+
+    /* slave which fails is dropped (left in bootloader, not rebooted),
+     * remaining ones are still updated */
+    std::vector<Slave> slaveSeq;
+    SlaveIDSeq failedSeq;
+    uint16_t flashPageUpdatedNum = 0;
+
+    const auto forEachSlave =
+        [&](const std::function<void(Slave &)> &handle)
         {
-            {SLAVE, slaveID},
-            {FCODE, FCODE_WR_BYTES},
-            {ADDR, RTU_ADDR_BASE + 0},
-            {COUNT, 1},
-            {VALUE,  std::vector<uint8_t>{FLAG_WATCHDOG_RESET}}
+            for(auto slave = std::begin(slaveSeq); slave != std::end(slaveSeq);)
+            {
+                try
+                {
+                    handle(*slave);
+                    ++slave;
+                }
+                catch(const std::exception &except)
+                {
+                    ATRACE(
+                        atrace::Level::Error,
+                        "slave ", slave->id, " failed: ", except.what(),
+                        ", dropped from update");
+                    failedSeq.push_back(slave->id);
+                    slave = slaveSeq.erase(slave);
+                }
+            }
+        };
+
+    if(0 > crcAddr)
+    {
+        ATRACE(
+            atrace::Level::Warning,
+            "crc register not configured, broadcast page data is not verified");
+    }
+
+    for(const auto slaveID : slaveIDSeq) slaveSeq.push_back({slaveID, 0});
+
+    forEachSlave(
+        [&](Slave &slave)
+        {
+            ENSURE(
+                0 == fetchFlashPageWrNum(brokerAddress, serviceName, slave.id),
+                RuntimeError);
+        });
+
+    for(const auto &flashPage : flashPageSeq)
+    {
+        if(slaveSeq.empty()) break;
+
+        yieldWhileBusy(brokerAddress, serviceName, slaveSeq.front().id);
+        ATRACE(atrace::Level::Info, "broadcasting page[", flashPageUpdatedNum, "] ", flashPage);
+
+        try
+        {
+            handleWatchdogReset(brokerAddress, serviceName, BROADCAST_SLAVE_ID);
+            std::this_thread::sleep_for(settleDelay);
+            handleFlashPageFill(brokerAddress, serviceName, BROADCAST_SLAVE_ID, flashPage);
+            std::this_thread::sleep_for(settleDelay);
+            handleFlashPageUpdate(brokerAddress, serviceName, BROADCAST_SLAVE_ID);
+            std::this_thread::sleep_for(std::max(settleDelay, flashPageWrDelay));
         }
-    };
+        catch(std::exception &except)
+        {
+            /* broadcast itself failed, it affects all slaves */
+            ATRACE(
+                atrace::Level::Error,
+                except.what(),
+                " while flashing ", flashPage);
+            throw;
+        }
+
+        forEachSlave(
+            [&](Slave &slave)
+            {
+                const auto status =
+                    fetchFlashPageStatus(brokerAddress, serviceName, slave.id);
 
-    auto requestPayload = std::string{request.dump()};
+                if(slave.wrNum + 1 == status.wrNum && flashPage.addr() == status.addr)
+                {
+                    ++slave.wrNum;
+                    return;
+                }
 
-    Client client;
+                if(slave.wrNum + 1 == status.wrNum)
+                {
+                    const auto stalePage =
+                        std::find_if(
+                            std::begin(flashPageSeq), std::end(flashPageSeq),
+                            [&](const FlashPage &page){return status.addr == page.addr();});
+
+                    ATRACE(
+                        atrace::Level::Warning,
+                        "slave ", slave.id, " wrote page[", flashPageUpdatedNum,
+                        "] at ", status.addr, ", unicast restore");
+
+                    /* stale address outside of image can not be restored */
+                    ENSURE(std::end(flashPageSeq) != stalePage, RuntimeError);
+                    ++slave.wrNum;
+                    flashPageUnicast(
+                        brokerAddress, serviceName, slave.id, slave.wrNum, *stalePage);
+                    ++slave.wrNum;
+                }
+                else
+                {
+                    ATRACE(
+                        atrace::Level::Warning,
+                        "slave ", slave.id, " missed page[", flashPageUpdatedNum,
+                        "] (wr num ", status.wrNum, "), unicast re-send");
+                }
 
-    TRACE(TraceLevel::Debug, requestPayload);
+                flashPageUnicast(brokerAddress, serviceName, slave.id, slave.wrNum, flashPage);
+                ++slave.wrNum;
+            });
+        ++flashPageUpdatedNum;
+    }
 
-    const auto replyPayload =
-        client.exec(brokerAddress, serviceName, {std::move(requestPayload)});
+    forEachSlave(
+        [&](Slave &slave)
+        {
+            const auto wrNum = fetchFlashPageWrNum(brokerAddress, serviceName, slave.id);
 
-    ENSURE(2 == int(replyPayload.size()), RuntimeError);
-    ENSURE(MDP::Broker::Signature::statusSucess == replyPayload[0], RuntimeError);
+            ATRACE(atrace::Level::Info, "slave ", slave.id, " pages written ", wrNum);
+            ENSURE(slave.wrNum == wrNum, RuntimeError);
 
-    validateReply(request, json::parse(replyPayload.back()));
+            if(0 > crcAddr || flashPageSeq.empty()) return;
+            if(crcMatch(brokerAddress, serviceName, slave.id, checksum, uint16_t(crcAddr))) return;
+
+            ATRACE(atrace::Level::Warning, "slave ", slave.id, " crc mismatch, unicast re-send");
+
+            for(const auto &flashPage : flashPageSeq)
+            {
+                flashPageUnicast(brokerAddress, serviceName, slave.id, slave.wrNum, flashPage);
+                ++slave.wrNum;
+            }
+            ENSURE(
+                crcMatch(brokerAddress, serviceName, slave.id, checksum, uint16_t(crcAddr)),
+                RuntimeError);
+        });
+
+    forEachSlave(
+        [&](Slave &slave)
+        {
+            ATRACE(atrace::Level::Info, "rebooting slave ", slave.id);
+            handleReboot(brokerAddress, serviceName, slave.id);
+        });
+
+    for(const auto slaveID : failedSeq)
+    {
+        ATRACE(atrace::Level::Error, "slave ", slaveID, " not updated");
+    }
+    ENSURE(failedSeq.empty(), RuntimeError);
 }
 
-void handleReboot(
+void firmwareUpdate(
+    const RecordSeq &recordSeq,
     const std::string &brokerAddress,
     const std::string &serviceName,
-    uint8_t slaveID)
+    const SlaveIDSeq &slaveIDSeq,
+    std::chrono::milliseconds settleDelay,
+    int crcAddr)
+{
+    const auto flashImage = toFlashImage(std::begin(recordSeq), std::end(recordSeq));
+    const auto flashPageSeq = flashImage.pageSeq();
+
+    ATRACE(atrace::Level::Info, "image ", recordSeq.size(), " records");
+    ATRACE(atrace::Level::Info, "flush ", flashPageSeq.size(), " pages");
+
+    if(0 < settleDelay.count())
+    {
+        /* crc requires continuous image, only computed if it is verified */
+        const auto checksum = 0 > crcAddr ? Checksum{} : calcChecksum(recordSeq);
+
+        firmwareUpdateBroadcast(
+            flashPageSeq, brokerAddress, serviceName, slaveIDSeq, settleDelay,
+            checksum, crcAddr);
+        return;
+    }
+
+    for(const auto slaveID : slaveIDSeq)
+    {
+        firmwareUpdateUnicast(flashPageSeq, brokerAddress, serviceName, slaveID);
+    }
+}
+
+/* Dry run: update requests are built but not executed, duration is
+ * estimated from bus model:
+ *
+ * request     = broker round trip + bus time of its frames
+ * bus time    = (frame bytes + 3.5 char gap per frame) * 11 bits / baud rate
+ * throttling  = request / bus share, at least bus bytes / max bus rate
+ *
+ * broker round trip is configured or measured from capture log (median of
+ * recorded round trip minus its bus time)
+ *
+ * page and device figures are for selected mode, broadcast updates all
+ * devices of a service at once so device duration is service duration */
+struct BusModel
 {
-    json request
+    uint32_t baudRate;
+    std::chrono::microseconds brokerRtt;
+    bool brokerRttMeasured;
+    std::chrono::milliseconds flashPageWrLatency;
+    std::chrono::milliseconds settleDelay;
+    uint32_t maxBusRate;
+    double maxBusShare;
+    bool lowPriority;
+    int crcAddr;
+};
+
+double toBusSeconds(const json &request, uint32_t baudRate)
+{
+    constexpr double bitsPerChar = 11;
+    constexpr double gapChars = 3.5;
+    uint64_t frames = 0;
+
+    for(const auto &transaction : request)
     {
+        frames += BROADCAST_SLAVE_ID == transaction[SLAVE] ? 1 : 2;
+    }
+    return (toBusBytes(request) + gapChars * frames) * bitsPerChar / baudRate;
+}
+
+/* broker round trip of recorded successful requests */
+std::chrono::microseconds measureBrokerRtt(
+    const std::vector<session::Entry> &entrySeq,
+    uint32_t baudRate)
+{
+    using namespace std::chrono;
+
+    std::vector<microseconds> rttSeq;
+
+    for(const auto &entry : entrySeq)
+    {
+        if(!entry.error.empty()) continue;
+
+        const auto busTime =
+            duration_cast<microseconds>(
+                duration<double>(toBusSeconds(entry.request, baudRate)));
+
+        rttSeq.push_back(std::max(microseconds{0}, entry.rtt - busTime));
+    }
+
+    ENSURE(!rttSeq.empty(), RuntimeError);
+
+    const auto median = std::next(std::begin(rttSeq), rttSeq.size() / 2);
+
+    std::nth_element(std::begin(rttSeq), median, std::end(rttSeq));
+    return *median;
+}
+
+struct Estimate
+{
+    uint64_t requests{0};
+    uint64_t transactions{0};
+    uint64_t frames{0};
+    uint64_t busBytes{0};
+    double seconds{0};
+
+    void add(const json &request, const BusModel &model)
+    {
+        uint64_t requestFrames = 0;
+
+        for(const auto &transaction : request)
         {
-            {SLAVE, slaveID},
-            {FCODE, FCODE_WR_BYTES},
-            {ADDR, RTU_ADDR_BASE + 0},
-            {COUNT, 1},
-            {VALUE,  std::vector<uint8_t>{FLAG_REBOOT}}
+            requestFrames += BROADCAST_SLAVE_ID == transaction[SLAVE] ? 1 : 2;
         }
-    };
 
-    auto requestPayload = std::string{request.dump()};
+        const auto bytes = toBusBytes(request);
+        auto requestSeconds =
+            std::chrono::duration<double>(model.brokerRtt).count()
+            + toBusSeconds(request, model.baudRate);
 
-    TRACE(TraceLevel::Debug, requestPayload);
+        requestSeconds /= model.maxBusShare;
 
-    Client client;
+        if(0 < model.maxBusRate)
+        {
+            requestSeconds = std::max(requestSeconds, double(bytes) / model.maxBusRate);
+        }
 
-    const auto replyPayload =
-        client.exec(brokerAddress, serviceName, {std::move(requestPayload)});
+        ++requests;
+        transactions += request.size();
+        frames += requestFrames;
+        busBytes += bytes;
+        seconds += requestSeconds;
+    }
+
+    Estimate &operator+= (const Estimate &other)
+    {
+        requests += other.requests;
+        transactions += other.transactions;
+        frames += other.frames;
+        busBytes += other.busBytes;
+        seconds += other.seconds;
+        return *this;
+    }
 
-    ENSURE(2 == int(replyPayload.size()), RuntimeError);
-    ENSURE(MDP::Broker::Signature::statusSucess == replyPayload[0], RuntimeError);
+    void wait(std::chrono::milliseconds delay)
+    {
+        seconds += std::chrono::duration<double>(delay).count();
+    }
 
-    validateReply(request, json::parse(replyPayload.back()));
+    json toJson() const
+    {
+        return
+        {
+            {"requests", requests},
+            {"transactions", transactions},
+            {"frames", frames},
+            {"bus_bytes", busBytes},
+            {"duration_s", seconds}
+        };
+    }
+};
+
+Estimate estimateFlashPageUnicast(
+    const FlashPage &flashPage,
+    uint8_t slaveID,
+    const BusModel &model)
+{
+    Estimate estimate;
+
+    estimate.add(toReadRequest(slaveID, RTU_ADDR_BASE + 2, 2), model);
+    estimate.add(toFlagsRequest(slaveID, FLAG_WATCHDOG_RESET), model);
+    estimate.add(toModbusRequest(flashPage, slaveID), model);
+    estimate.add(toFlagsRequest(slaveID, FLAG_FLASH_PAGE_UPDATE), model);
+    estimate.wait(std::max(model.flashPageWrLatency, flashPageWrDelay));
+    return estimate;
 }
 
-void firmwareUpdate(
-    std::ifstream &file,
-    const std::string &brokerAddress,
-    const std::string &serviceName,
-    uint8_t slaveID)
+/* whole bus, assuming no slave misses the page */
+Estimate estimateFlashPageBroadcast(
+    const FlashPage &flashPage,
+    const SlaveIDSeq &slaveIDSeq,
+    const BusModel &model)
 {
-    auto recordSeq = parseRecordSeq(file);
-    auto flashPageSeq = toFlashPageSeq(std::begin(recordSeq), std::end(recordSeq));
+    Estimate estimate;
+
+    estimate.add(toFlagsRequest(BROADCAST_SLAVE_ID, FLAG_WATCHDOG_RESET), model);
+    estimate.wait(model.settleDelay);
+    estimate.add(toModbusRequest(flashPage, BROADCAST_SLAVE_ID), model);
+    estimate.wait(model.settleDelay);
+    estimate.add(toFlagsRequest(BROADCAST_SLAVE_ID, FLAG_FLASH_PAGE_UPDATE), model);
+    estimate.wait(
+        std::max(
+            model.settleDelay,
+            std::max(model.flashPageWrLatency, flashPageWrDelay)));
+
+    /* page write counter and latched page address */
+    for(const auto id : slaveIDSeq)
+    {
+        estimate.add(toReadRequest(id, RTU_ADDR_BASE + 2, 6), model);
+    }
+    return estimate;
+}
 
+json plan(
+    const RecordSeq &recordSeq,
+    std::size_t serviceNum,
+    const SlaveIDSeq &slaveIDSeq,
+    const BusModel &model)
+{
+    const auto flashImage = toFlashImage(std::begin(recordSeq), std::end(recordSeq));
+    const auto flashPageSeq = flashImage.pageSeq();
+    const auto slaveID = slaveIDSeq.front();
+    const bool broadcast = 0 < model.settleDelay.count();
+    /* image data, without erased padding of partial pages */
+    const auto dataSize =
+        std::accumulate(
+            std::begin(flashPageSeq), std::end(flashPageSeq), std::size_t{0},
+            [](std::size_t size, const FlashPage &flashPage)
+            {return size + flashPage.size();});
+    Estimate page;
+    Estimate device;
+    Estimate service;
+    json notModelled{"failed requests, timeouts and their retries"};
+
+    if(broadcast)
     {
-        uint16_t flashPageUpdatedNum = 0;
+        if(!flashPageSeq.empty())
+        {
+            page = estimateFlashPageBroadcast(flashPageSeq.front(), slaveIDSeq, model);
+        }
 
-        TRACE(TraceLevel::Info, "ihex ", recordSeq.size(), " records");
-        TRACE(TraceLevel::Info, "flush ", flashPageSeq.size(), " pages");
+        for(const auto id : slaveIDSeq)
+        {
+            service.add(toReadRequest(id, RTU_ADDR_BASE + 2, 2), model);
+        }
 
         for(const auto &flashPage : flashPageSeq)
         {
-            TRACE(TraceLevel::Info, "flashing page[", flashPageUpdatedNum, "] ", flashPage);
+            service += estimateFlashPageBroadcast(flashPage, slaveIDSeq, model);
+        }
 
-            try
+        for(const auto id : slaveIDSeq)
+        {
+            service.add(toReadRequest(id, RTU_ADDR_BASE + 2, 2), model);
+
+            if(0 <= model.crcAddr && !flashPageSeq.empty())
             {
-               ENSURE(
-                   flashPageUpdatedNum
-                   == fetchFlashPageWrNum(brokerAddress, serviceName, slaveID),
-                   RuntimeError);
-
-                handleWatchdogReset(brokerAddress, serviceName, slaveID);
-                handleFlashPageFill(brokerAddress, serviceName, slaveID, flashPage);
-                handleFlashPageUpdate(brokerAddress, serviceName, slaveID);
-                ++flashPageUpdatedNum;
-                std::this_thread::sleep_for(std::chrono::milliseconds{250});
+                service.add(toReadRequest(id, uint16_t(model.crcAddr), 2), model);
             }
-            catch(std::exception &except)
+            service.add(toFlagsRequest(id, FLAG_REBOOT), model);
+        }
+
+        /* all devices are updated at once */
+        device = service;
+        notModelled.push_back("missed broadcast pages and their unicast re-sends");
+    }
+    else
+    {
+        if(!flashPageSeq.empty())
+        {
+            page = estimateFlashPageUnicast(flashPageSeq.front(), slaveID, model);
+        }
+
+        for(const auto &flashPage : flashPageSeq)
+        {
+            device += estimateFlashPageUnicast(flashPage, slaveID, model);
+        }
+        device.add(toFlagsRequest(slaveID, FLAG_REBOOT), model);
+
+        /* slaves are updated one after another */
+        for(std::size_t i = 0; i < slaveIDSeq.size(); ++i) service += device;
+    }
+
+    if(model.lowPriority) notModelled.push_back("low priority back-off (-y)");
+
+    return
+    {
+        {
+            "image",
             {
-                /* TODO: impl. retry & recovery */
-                TRACE(
-                    TraceLevel::Error,
-                    except.what(),
-                    " while flashing ", flashPage);
-                throw;
+                {"pages", flashPageSeq.size()},
+                {"bytes", dataSize},
+                {"padded_bytes", flashPageSeq.size() * flashImage.pageSize()}
+            }
+        },
+        {
+            "model",
+            {
+                {"mode", broadcast ? "broadcast" : "unicast"},
+                {"baud_rate", model.baudRate},
+                {"broker_rtt_us", model.brokerRtt.count()},
+                {"broker_rtt", model.brokerRttMeasured ? "measured" : "configured"},
+                {"page_write_ms", std::max(model.flashPageWrLatency, flashPageWrDelay).count()},
+                {"broadcast_settle_ms", model.settleDelay.count()},
+                {"max_bus_bytes_per_sec", model.maxBusRate},
+                {"max_bus_share", model.maxBusShare},
+                {"not_modelled", notModelled}
             }
+        },
+        {"page", flashPageSeq.empty() ? json{} : page.toJson()},
+        {"device", device.toJson()},
+        /* services are separate buses, updated in parallel */
+        {"service", service.toJson()},
+        {
+            "fleet",
+            {
+                {"services", serviceNum},
+                {"devices", serviceNum * slaveIDSeq.size()},
+                {"duration_s", service.seconds}
+            }
+        }
+    };
+}
+
+using ServiceNameSeq = std::vector<std::string>;
+
+/* crcAddr: bootloader register holding crc16 (high, low byte) of flashed
+ * fw, negative if slaves do not provide one */
+json scanDevice(
+    const std::string &brokerAddress,
+    const std::string &serviceName,
+    uint8_t slaveID,
+    const Checksum &checksum,
+    int crcAddr)
+{
+    json device
+    {
+        {"service", serviceName},
+        {"slave", slaveID}
+    };
+
+    try
+    {
+        const auto wrNum = fetchFlashPageWrNum(brokerAddress, serviceName, slaveID);
+
+        device["wr_num"] = wrNum;
+
+        if(0 > crcAddr)
+        {
+            /* update starts at 0 and writes at least image page number of
+             * pages (broadcast recovery writes more), fewer is an update
+             * which did not complete */
+            const bool interrupted = 0 != wrNum && checksum.pageNum() > wrNum;
+
+            device["action"] = interrupted ? "investigate" : "update";
+            device["reason"] =
+                interrupted ? "interrupted update" : "crc register not configured";
+            return device;
         }
 
-        TRACE(TraceLevel::Info, "rebooting");
-        handleReboot(brokerAddress, serviceName, slaveID);
+        /* flashed content decides, counter may be above page number after
+         * broadcast recovery */
+
+        const auto crc =
+            fetchBytes(brokerAddress, serviceName, slaveID, uint16_t(crcAddr), 2);
+        const bool match =
+            crc == std::vector<uint8_t>{checksum.highByte, checksum.lowByte};
+
+        device["crc"] = crc;
+        device["action"] = match ? "skip" : "update";
+        device["reason"] = match ? "crc match" : "crc mismatch";
+    }
+    catch(const std::exception &except)
+    {
+        device["action"] = "investigate";
+        device["reason"] = except.what();
     }
+    return device;
+}
+
+/* query all (service, slave) pairs on jobNum threads, plan lists devices
+ * in (service, slave) order */
+json scan(
+    const RecordSeq &recordSeq,
+    const std::string &brokerAddress,
+    const ServiceNameSeq &serviceNameSeq,
+    const SlaveIDSeq &slaveIDSeq,
+    int crcAddr,
+    unsigned jobNum)
+{
+    const auto checksum = calcChecksum(recordSeq);
+    const auto deviceNum = serviceNameSeq.size() * slaveIDSeq.size();
+    std::vector<json> deviceSeq(deviceNum);
+    std::atomic<std::size_t> next{0};
+
+    auto worker =
+        [&]()
+        {
+            for(auto i = next.fetch_add(1); i < deviceNum; i = next.fetch_add(1))
+            {
+                deviceSeq[i] =
+                    scanDevice(
+                        brokerAddress,
+                        serviceNameSeq[i / slaveIDSeq.size()],
+                        slaveIDSeq[i % slaveIDSeq.size()],
+                        checksum, crcAddr);
+            }
+        };
+
+    std::vector<std::thread> workerSeq;
+
+    jobNum = std::max(1u, std::min(jobNum, unsigned(deviceNum)));
+
+    for(unsigned i = 0; i < jobNum; ++i) workerSeq.emplace_back(worker);
+    for(auto &thread : workerSeq) thread.join();
+
+    json summary{{"skip", 0}, {"update", 0}, {"investigate", 0}};
+
+    for(const auto &device : deviceSeq)
+    {
+        summary[device["action"].get<std::string>()] =
+            summary[device["action"].get<std::string>()].get<int>() + 1;
+    }
+
+    return
+    {
+        {
+            "image",
+            {
+                {"crc", std::vector<uint8_t>{checksum.highByte, checksum.lowByte}},
+                {"size", checksum.size},
+                {"pages", checksum.pageNum()}
+            }
+        },
+        {"summary", summary},
+        {"devices", deviceSeq}
+    };
 }
 
 } /* namespace */
@@ -418,11 +1229,30 @@ void firmwareUpdate(
 int main(int argc, char *const argv[])
 {
     std::string brokerAddress;
-    std::string serviceName;
+    ServiceNameSeq serviceNameSeq;
     std::string fileName;
-    int slaveID = -1;
-
-    for(int c; -1 != (c = ::getopt(argc, argv, "ha:s:f:t:"));)
+    SlaveIDSeq slaveIDSeq;
+    bool slaveIDValid = true;
+    int settleDelayMs = 0;
+    long baseAddr = image::NO_BASE_ADDR;
+    int maxBusRate = 0;
+    int maxBusShare = 100;
+    bool lowPriority = false;
+    bool scanMode = false;
+    bool dryRun = false;
+    int baudRate = 19200;
+    int brokerRttMs = 5;
+    bool brokerRttSet = false;
+    int flashPageWrLatencyMs = 0;
+    int crcAddr = -1;
+    int jobNum = 8;
+    std::string captureFileName;
+    std::string replayFileName;
+    double replayScale = 1.0;
+    bool replayScaleSet = false;
+    int traceLevel = ATRACE_LEVEL;
+
+    for(int c; -1 != (c = ::getopt(argc, argv, "ha:s:f:o:t:b:r:u:yxc:j:nR:T:W:w:p:P:l:"));)
     {
         switch(c)
         {
@@ -434,13 +1264,77 @@ int main(int argc, char *const argv[])
                 brokerAddress = optarg ? optarg : "";
                 break;
             case 's':
-                serviceName = optarg ? optarg : "";
+                serviceNameSeq.push_back(optarg ? optarg : "");
                 break;
             case 'f':
                 fileName = optarg ? optarg : "";
                 break;
+            case 'o':
+                baseAddr = optarg ? ::strtol(optarg, nullptr, 0) : -1;
+                break;
             case 't':
-                slaveID = optarg ? ::atoi(optarg) : -1;
+            {
+                /* slaveID or first-last */
+                const char *last = optarg ? std::strchr(optarg, '-') : nullptr;
+                const auto firstID = optarg ? ::atoi(optarg) : -1;
+                const auto lastID = last ? ::atoi(last + 1) : firstID;
+
+                slaveIDValid =
+                    slaveIDValid
+                    && 1 <= firstID && firstID <= lastID && 255 >= lastID;
+
+                for(auto slaveID = firstID; slaveIDValid && slaveID <= lastID; ++slaveID)
+                {
+                    slaveIDSeq.push_back(uint8_t(slaveID));
+                }
+                break;
+            }
+            case 'x':
+                scanMode = true;
+                break;
+            case 'c':
+                crcAddr = optarg ? int(::strtol(optarg, nullptr, 0)) : -1;
+                break;
+            case 'j':
+                jobNum = optarg ? ::atoi(optarg) : -1;
+                break;
+            case 'n':
+                dryRun = true;
+                break;
+            case 'R':
+                baudRate = optarg ? ::atoi(optarg) : -1;
+                break;
+            case 'T':
+                brokerRttMs = optarg ? ::atoi(optarg) : -1;
+                brokerRttSet = true;
+                break;
+            case 'W':
+                flashPageWrLatencyMs = optarg ? ::atoi(optarg) : -1;
+                break;
+            case 'w':
+                captureFileName = optarg ? optarg : "";
+                break;
+            case 'p':
+                replayFileName = optarg ? optarg : "";
+                break;
+            case 'P':
+                replayScale = optarg ? ::atof(optarg) : -1.0;
+                replayScaleSet = true;
+                break;
+            case 'b':
+                settleDelayMs = optarg ? ::atoi(optarg) : -1;
+                break;
+            case 'r':
+                maxBusRate = optarg ? ::atoi(optarg) : -1;
+                break;
+            case 'u':
+                maxBusShare = optarg ? ::atoi(optarg) : -1;
+                break;
+            case 'y':
+                lowPriority = true;
+                break;
+            case 'l':
+                traceLevel = optarg ? ::atoi(optarg) : -1;
                 break;
             case ':':
             case '?':
@@ -452,29 +1346,116 @@ int main(int argc, char *const argv[])
     }
 
     if(
-        brokerAddress.empty()
-        || serviceName.empty()
+        (!dryRun && replayFileName.empty() && brokerAddress.empty())
+        || (!dryRun && serviceNameSeq.empty())
+        || (!captureFileName.empty() && !replayFileName.empty())
+        || replayScale < 0.0
+        || (replayScaleSet && (dryRun || replayFileName.empty()))
+        /* dry run sends nothing, capture file would only be truncated */
+        || (dryRun && !captureFileName.empty())
+        || std::any_of(
+            std::begin(serviceNameSeq), std::end(serviceNameSeq),
+            [](const std::string &serviceName){return serviceName.empty();})
+        || (!scanMode && !dryRun && 1 != serviceNameSeq.size())
         || fileName.empty()
-        || slaveID < 1
-        || slaveID > 255)
+        || (image::NO_BASE_ADDR != baseAddr && !inRange<uint16_t>(baseAddr))
+        || slaveIDSeq.empty()
+        || !slaveIDValid
+        || settleDelayMs < 0
+        || maxBusRate < 0
+        || maxBusShare < 1
+        || maxBusShare > 100
+        || (-1 != crcAddr && !inRange<uint16_t>(crcAddr))
+        || jobNum < 1
+        || baudRate < 1
+        || brokerRttMs < 0
+        || (dryRun && brokerRttSet && !replayFileName.empty())
+        || flashPageWrLatencyMs < 0
+        || traceLevel < int(atrace::Level::Error)
+        || traceLevel > int(atrace::Level::Debug))
     {
         help(argv[0], "missing/invalid required arguments");
         return EXIT_FAILURE;
     }
 
+    if(
+        image::NO_BASE_ADDR != baseAddr
+        && image::Format::Bin != image::toFormat(fileName))
+    {
+        help(argv[0], "-o applies to .bin only");
+        return EXIT_FAILURE;
+    }
+
+    atrace::setLevel(atrace::Level(traceLevel));
+    throttle().configure(uint32_t(maxBusRate), maxBusShare / 100.0, lowPriority);
+
     try
     {
-        std::ifstream file{fileName};
-        firmwareUpdate(file, brokerAddress, serviceName, slaveID);
+        if(!captureFileName.empty())
+        {
+            recorder().reset(new session::Recorder{captureFileName});
+        }
+
+        /* dry run uses replay file only to measure broker round trip */
+        if(!replayFileName.empty() && !dryRun)
+        {
+            replay().reset(new session::Replay{replayFileName, replayScale});
+        }
+
+        const auto recordSeq = image::load(fileName, int32_t(baseAddr));
+
+        if(dryRun)
+        {
+            const BusModel model
+            {
+                uint32_t(baudRate),
+                replayFileName.empty()
+                ? std::chrono::microseconds{std::chrono::milliseconds{brokerRttMs}}
+                : measureBrokerRtt(
+                    session::Replay{replayFileName, 0.0}.entrySeq(),
+                    uint32_t(baudRate)),
+                !replayFileName.empty(),
+                std::chrono::milliseconds{flashPageWrLatencyMs},
+                std::chrono::milliseconds{settleDelayMs},
+                uint32_t(maxBusRate),
+                maxBusShare / 100.0,
+                lowPriority,
+                crcAddr
+            };
+
+            std::cout
+                << plan(
+                    recordSeq, std::max(std::size_t{1}, serviceNameSeq.size()),
+                    slaveIDSeq, model).dump(2)
+                << std::endl;
+            return EXIT_SUCCESS;
+        }
+
+        if(scanMode)
+        {
+            const auto inventory =
+                scan(
+                    recordSeq, brokerAddress, serviceNameSeq, slaveIDSeq,
+                    crcAddr, unsigned(jobNum));
+
+            std::cout << inventory.dump(2) << std::endl;
+            return EXIT_SUCCESS;
+        }
+
+        firmwareUpdate(
+            recordSeq,
+            brokerAddress, serviceNameSeq.front(), slaveIDSeq,
+            std::chrono::milliseconds{settleDelayMs},
+            crcAddr);
     }
     catch(const std::exception &except)
     {
-        TRACE(TraceLevel::Error, except.what());
+        ATRACE(atrace::Level::Error, except.what());
         return EXIT_FAILURE;
     }
     catch(...)
     {
-        TRACE(TraceLevel::Error, "unsupported exception");
+        ATRACE(atrace::Level::Error, "unsupported exception");
         return EXIT_FAILURE;
     }
 
@@ -0,0 +1,232 @@
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <limits>
+
+#include <elf.h>
+
+#include "atrace.h"
+#include "image.h"
+
+namespace image {
+
+namespace {
+
+constexpr uint8_t FILL_BYTE = 0xFF;
+/* ihex::Record address and size are 16bit */
+constexpr std::size_t ADDR_END = std::size_t{std::numeric_limits<uint16_t>::max()} + 1;
+constexpr std::size_t RECORD_SIZE_MAX = std::numeric_limits<uint16_t>::max();
+
+bool endsWith(const std::string &str, const std::string &suffix)
+{
+    return
+        str.size() >= suffix.size()
+        && 0 == str.compare(str.size() - suffix.size(), suffix.size(), suffix);
+}
+
+/* continuous data at addr as single data record, unless it does not fit
+ * 16bit record size (only 64KiB image at 0) */
+void append(RecordSeq &seq, uint32_t addr, std::vector<uint8_t> data)
+{
+    ENSURE(addr + data.size() <= ADDR_END, RuntimeError);
+
+    if(RECORD_SIZE_MAX >= data.size())
+    {
+        seq.emplace_back(ihex::RecordType::Data, uint16_t(addr), std::move(data), 0);
+        return;
+    }
+
+    constexpr std::size_t half = ADDR_END / 2;
+    const auto begin = std::begin(data);
+
+    seq.emplace_back(
+        ihex::RecordType::Data, uint16_t(addr),
+        std::vector<uint8_t>(begin, begin + half), 0);
+    seq.emplace_back(
+        ihex::RecordType::Data, uint16_t(addr + half),
+        std::vector<uint8_t>(begin + half, std::end(data)), 0);
+}
+
+template <typename T>
+T read(const std::vector<uint8_t> &data, std::size_t offset)
+{
+    ENSURE(offset + sizeof(T) <= data.size(), RuntimeError);
+
+    T value;
+
+    std::memcpy(&value, data.data() + offset, sizeof(T));
+    return value;
+}
+
+struct Segment
+{
+    uint32_t addr;
+    const uint8_t *begin;
+    const uint8_t *end;
+};
+
+template <typename Ehdr, typename Phdr>
+std::vector<Segment> loadSegments(const std::vector<uint8_t> &data)
+{
+    const auto ehdr = read<Ehdr>(data, 0);
+
+    ENSURE(sizeof(Phdr) <= ehdr.e_phentsize, RuntimeError);
+
+    std::vector<Segment> seq;
+
+    for(std::size_t i = 0; i < ehdr.e_phnum; ++i)
+    {
+        const auto phdr = read<Phdr>(data, ehdr.e_phoff + i * ehdr.e_phentsize);
+
+        /* only file backed part of loadable segment is stored in flash */
+        if(PT_LOAD != phdr.p_type || 0 == phdr.p_filesz) continue;
+
+        ENSURE(phdr.p_offset + phdr.p_filesz <= data.size(), RuntimeError);
+
+        /* e.g. AVR .eeprom (0x810000) */
+        if(ADDR_END < phdr.p_paddr + phdr.p_filesz)
+        {
+            ATRACE(
+                atrace::Level::Warning,
+                "skipped segment paddr ", uint64_t(phdr.p_paddr),
+                " size ", uint64_t(phdr.p_filesz));
+            continue;
+        }
+
+        const auto begin = data.data() + phdr.p_offset;
+
+        seq.push_back({uint32_t(phdr.p_paddr), begin, begin + phdr.p_filesz});
+    }
+    return seq;
+}
+
+} /* namespace */
+
+Format toFormat(const std::string &fileName)
+{
+    if(endsWith(fileName, ".elf")) return Format::Elf;
+    if(endsWith(fileName, ".bin")) return Format::Bin;
+    return Format::IHex;
+}
+
+std::vector<uint8_t> readFile(const std::string &fileName)
+{
+    std::ifstream file{fileName, std::ios::binary | std::ios::ate};
+
+    ENSURE(file, RuntimeError);
+
+    const auto size = file.tellg();
+
+    ENSURE(0 <= size, RuntimeError);
+
+    std::vector<uint8_t> data(static_cast<std::size_t>(size));
+
+    file.seekg(0);
+    file.read(reinterpret_cast<char *>(data.data()), size);
+    ENSURE(file, RuntimeError);
+    return data;
+}
+
+RecordSeq parseIHex(const std::vector<uint8_t> &data)
+{
+    const std::string fileData{std::begin(data), std::end(data)};
+
+    auto curr = std::begin(fileData);
+    const auto end = std::end(fileData);
+    RecordSeq seq;
+
+    while(curr != end)
+    {
+        if('\n' == *curr)
+        {
+            std::advance(curr, 1);
+            continue;
+        }
+
+        auto i = std::find_if(curr, end, [](char c){return '\n' == c;});
+
+        seq.push_back(ihex::parseRecord(curr, i));
+        curr = i;
+    }
+    return seq;
+}
+
+RecordSeq parseElf(const std::vector<uint8_t> &data)
+{
+    ENSURE(EI_NIDENT <= data.size(), RuntimeError);
+    ENSURE(0 == std::memcmp(data.data(), ELFMAG, SELFMAG), RuntimeError);
+    /* headers are read in host byte order */
+    ENSURE(ELFDATA2LSB == data[EI_DATA], RuntimeError);
+
+    ENSURE(
+        ELFCLASS32 == data[EI_CLASS] || ELFCLASS64 == data[EI_CLASS],
+        RuntimeError);
+
+    auto segmentSeq =
+        ELFCLASS64 == data[EI_CLASS]
+        ? loadSegments<Elf64_Ehdr, Elf64_Phdr>(data)
+        : loadSegments<Elf32_Ehdr, Elf32_Phdr>(data);
+
+    ENSURE(!segmentSeq.empty(), RuntimeError);
+
+    std::sort(
+        std::begin(segmentSeq), std::end(segmentSeq),
+        [](const Segment &x, const Segment &y){return x.addr < y.addr;});
+
+    const uint32_t addrBegin = segmentSeq.front().addr;
+    uint32_t addr = addrBegin;
+
+    for(const auto &segment : segmentSeq)
+    {
+        /* overlapping segments are not supported */
+        ENSURE(addr <= segment.addr, RuntimeError);
+        addr = segment.addr + uint32_t(segment.end - segment.begin);
+    }
+
+    /* gaps between segments stay erased */
+    std::vector<uint8_t> image(addr - addrBegin, FILL_BYTE);
+
+    for(const auto &segment : segmentSeq)
+    {
+        std::copy(
+            segment.begin, segment.end,
+            std::next(std::begin(image), segment.addr - addrBegin));
+    }
+
+    RecordSeq seq;
+
+    append(seq, addrBegin, std::move(image));
+    return seq;
+}
+
+RecordSeq parseBin(std::vector<uint8_t> data, uint16_t baseAddr)
+{
+    RecordSeq seq;
+
+    if(!data.empty()) append(seq, baseAddr, std::move(data));
+    return seq;
+}
+
+RecordSeq parse(std::vector<uint8_t> data, Format format, int32_t baseAddr)
+{
+    /* base address of other formats is part of the file */
+    ENSURE(Format::Bin == format || NO_BASE_ADDR == baseAddr, RuntimeError);
+    ENSURE(NO_BASE_ADDR == baseAddr || 0 <= baseAddr, RuntimeError);
+
+    switch(format)
+    {
+        case Format::Elf: return parseElf(data);
+        case Format::Bin:
+            return parseBin(std::move(data), uint16_t(NO_BASE_ADDR == baseAddr ? 0 : baseAddr));
+        case Format::IHex: break;
+    }
+    return parseIHex(data);
+}
+
+RecordSeq load(const std::string &fileName, int32_t baseAddr)
+{
+    return parse(readFile(fileName), toFormat(fileName), baseAddr);
+}
+
+} /* image */
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "ihex.h"
+
+/* Firmware image sources:
+ *
+ * Intel HEX (.hex)  : text records, parsed by ihex::parseRecord
+ * ELF (.elf)        : PT_LOAD segments at physical addresses,
+ *                     gaps between segments filled with 0xFF (erased flash)
+ * raw binary (.bin) : data placed at base address
+ *
+ * every source is converted to sequence of ihex::Record, so the same
+ * flash page and checksum code consumes all of them; ELF and raw binary
+ * give one record per continuous address range (split only where record
+ * size exceeds 16bit) */
+
+namespace image {
+
+using RecordSeq = std::vector<ihex::Record>;
+
+enum class Format
+{
+    IHex,
+    Elf,
+    Bin
+};
+
+/* raw binary is placed at 0 if base address is not given, other formats
+ * carry their own addresses and reject it */
+constexpr int32_t NO_BASE_ADDR = -1;
+
+/* by file name extension, Intel HEX if unknown */
+Format toFormat(const std::string &fileName);
+
+/* whole file content */
+std::vector<uint8_t> readFile(const std::string &fileName);
+
+RecordSeq parseIHex(const std::vector<uint8_t> &data);
+RecordSeq parseElf(const std::vector<uint8_t> &data);
+RecordSeq parseBin(std::vector<uint8_t> data, uint16_t baseAddr);
+
+RecordSeq parse(std::vector<uint8_t> data, Format format, int32_t baseAddr = NO_BASE_ADDR);
+RecordSeq load(const std::string &fileName, int32_t baseAddr = NO_BASE_ADDR);
+
+} /* image */
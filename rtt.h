@@ -0,0 +1,96 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+
+/* Round trip time estimator (TCP RTO style, RFC 6298):
+ *
+ * srtt    = 7/8 srtt + 1/8 rtt
+ * rttvar  = 3/4 rttvar + 1/4 |srtt - rtt|
+ * timeout = srtt + 4 rttvar, clamped to [min, max]
+ *
+ * timeout is doubled (up to max) on each failed transaction
+ * until next successful sample */
+class RttEstimator
+{
+public:
+    using Duration = std::chrono::microseconds;
+
+    static constexpr Duration initial() {return std::chrono::milliseconds{1000};}
+    static constexpr Duration min() {return std::chrono::milliseconds{20};}
+    static constexpr Duration max() {return std::chrono::milliseconds{5000};}
+private:
+    bool valid_{false};
+    Duration srtt_{0};
+    Duration rttvar_{0};
+    Duration timeout_{initial()};
+
+    static Duration clamp(Duration value)
+    {
+        return std::min(max(), std::max(min(), value));
+    }
+public:
+    void update(Duration rtt)
+    {
+        if(!valid_)
+        {
+            srtt_ = rtt;
+            rttvar_ = rtt / 2;
+            valid_ = true;
+        }
+        else
+        {
+            const auto err = srtt_ > rtt ? srtt_ - rtt : rtt - srtt_;
+
+            rttvar_ = (3 * rttvar_ + err) / 4;
+            srtt_ = (7 * srtt_ + rtt) / 8;
+        }
+        timeout_ = clamp(srtt_ + 4 * rttvar_);
+    }
+
+    void backoff()
+    {
+        timeout_ = clamp(2 * timeout_);
+    }
+
+    bool valid() const {return valid_;}
+    Duration srtt() const {return srtt_;}
+    Duration rttvar() const {return rttvar_;}
+    Duration timeout() const {return timeout_;}
+};
+
+/* estimators per service, slave and request shape (requests of different
+ * size have different transmission times), safe for concurrent use */
+class RttTable
+{
+public:
+    using Key = std::tuple<std::string, uint8_t, std::string>;
+private:
+    mutable std::mutex mutex_;
+    std::map<Key, RttEstimator> table_;
+public:
+    RttEstimator get(const Key &key) const
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        const auto i = table_.find(key);
+
+        return std::end(table_) == i ? RttEstimator{} : i->second;
+    }
+
+    void update(const Key &key, RttEstimator::Duration rtt)
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        table_[key].update(rtt);
+    }
+
+    void backoff(const Key &key)
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        table_[key].backoff();
+    }
+};
@@ -0,0 +1,97 @@
+#include <thread>
+
+#include <nlohmann/json.hpp>
+
+#include "Ensure.h"
+#include "session.h"
+
+namespace session {
+
+using json = nlohmann::json;
+
+Recorder::Recorder(const std::string &fileName):
+    log_{fileName, std::ios::trunc},
+    start_{Clock::now()}
+{
+    ENSURE(log_, RuntimeError);
+}
+
+void Recorder::record(
+    Clock::time_point begin,
+    Clock::time_point end,
+    const std::string &service,
+    const std::string &request,
+    const FrameSeq &reply,
+    const std::string &error)
+{
+    using std::chrono::duration_cast;
+
+    json entry
+    {
+        {"t_us", duration_cast<Duration>(begin - start_).count()},
+        {"rtt_us", duration_cast<Duration>(end - begin).count()},
+        {"service", service},
+        {"request", request}
+    };
+
+    if(error.empty()) entry["reply"] = reply;
+    else entry["error"] = error;
+
+    std::lock_guard<std::mutex> lock{mutex_};
+
+    /* flushed per entry, so log survives failed update */
+    log_ << entry.dump() << std::endl;
+    ENSURE(log_, RuntimeError);
+}
+
+Replay::Replay(const std::string &fileName, double scale):
+    scale_{scale}
+{
+    std::ifstream log{fileName};
+
+    ENSURE(log, RuntimeError);
+
+    for(std::string line; std::getline(log, line);)
+    {
+        if(line.empty()) continue;
+
+        const auto entry = json::parse(line);
+        auto request = json::parse(entry["request"].get<std::string>());
+
+        for(auto &transaction : request) transaction.erase("timeout_ms");
+
+        entrySeq_.push_back(
+            {
+                Duration{entry["t_us"].get<int64_t>()},
+                Duration{entry["rtt_us"].get<int64_t>()},
+                entry["service"].get<std::string>(),
+                std::move(request),
+                entry.count("reply") ? entry["reply"].get<FrameSeq>() : FrameSeq{},
+                entry.count("error") ? entry["error"].get<std::string>() : std::string{}
+            });
+    }
+    used_.assign(entrySeq_.size(), false);
+}
+
+Entry Replay::take(const std::function<bool(const Entry &)> &match)
+{
+    Entry entry;
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+        std::size_t i = 0;
+
+        while(i < entrySeq_.size() && (used_[i] || !match(entrySeq_[i]))) ++i;
+
+        /* replayed session diverged from recorded one */
+        ENSURE(i < entrySeq_.size(), RuntimeError);
+
+        used_[i] = true;
+        entry = entrySeq_[i];
+    }
+
+    std::this_thread::sleep_for(
+        std::chrono::duration_cast<Duration>(entry.rtt * scale_));
+    return entry;
+}
+
+} /* session */
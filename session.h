@@ -0,0 +1,79 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+/* Record and replay of MDP request/reply payloads:
+ *
+ * log is a sequence of JSON lines, one per request:
+ * {"t_us": start offset, "rtt_us": round trip, "service": name,
+ *  "request": payload, "reply": [frames...]} or "error": message
+ * if request failed with exception
+ *
+ * replay serves recorded replies without broker, after recorded round
+ * trip time multiplied by scale (0: no delay); timeout_ms depends on
+ * measured round trip times, so it is stripped from recorded requests on
+ * load and is not part of request identity */
+
+namespace session {
+
+using Clock = std::chrono::steady_clock;
+using Duration = std::chrono::microseconds;
+using FrameSeq = std::vector<std::string>;
+
+struct Entry
+{
+    Duration offset;
+    Duration rtt;
+    std::string service;
+    /* parsed, without timeout_ms */
+    nlohmann::json request;
+    FrameSeq reply;
+    std::string error;
+};
+
+/* safe for concurrent use */
+class Recorder
+{
+    std::mutex mutex_;
+    std::ofstream log_;
+    const Clock::time_point start_;
+public:
+    explicit Recorder(const std::string &fileName);
+
+    void record(
+        Clock::time_point begin,
+        Clock::time_point end,
+        const std::string &service,
+        const std::string &request,
+        const FrameSeq &reply,
+        const std::string &error = {});
+};
+
+/* safe for concurrent use */
+class Replay
+{
+    std::mutex mutex_;
+    std::vector<Entry> entrySeq_;
+    std::vector<bool> used_;
+    double scale_;
+public:
+    Replay(const std::string &fileName, double scale);
+
+    /* first unused entry matching predicate (requests of concurrent
+     * clients may be recorded in any order), waits for its scaled round
+     * trip time, throws if there is none */
+    Entry take(const std::function<bool(const Entry &)> &match);
+
+    /* all recorded entries, used or not */
+    const std::vector<Entry> &entrySeq() const {return entrySeq_;}
+};
+
+} /* session */
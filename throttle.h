@@ -0,0 +1,120 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#include "rtt.h"
+
+/* Bus traffic shaping, so update can share service with other clients:
+ *
+ * - token bucket limits bus bytes/sec (rate 0: unlimited), bucket holds
+ *   one second worth of bytes
+ * - bus share f limits fraction of time spent in transactions, after
+ *   transaction of duration d caller sleeps d (1 - f) / f
+ * - low priority: queueing delay of service is estimated as difference
+ *   between last and minimal observed round trip time of same request
+ *   (broker queue depth is not visible to client), if it exceeds minimal
+ *   round trip time service is considered busy and caller backs off, step
+ *   by step (each one re-checked by caller with a probe request) until it
+ *   is not or maxYield() is reached
+ *
+ * safe for concurrent use */
+class Throttle
+{
+public:
+    using Key = RttTable::Key;
+    using Clock = std::chrono::steady_clock;
+    using Duration = std::chrono::microseconds;
+
+    static constexpr Duration maxBackoff() {return std::chrono::milliseconds{1000};}
+    static constexpr Duration maxYield() {return std::chrono::milliseconds{10000};}
+private:
+    std::mutex mutex_;
+    uint32_t rate_{0};
+    uint32_t burst_{0};
+    double busShare_{1.0};
+    bool lowPriority_{false};
+    double tokens_{0};
+    Clock::time_point refill_{Clock::now()};
+    std::map<Key, Duration> minRtt_;
+    Duration queueDelay_{0};
+    Duration lastMinRtt_{0};
+public:
+    /* bytesPerSec 0: unlimited, busShare (0, 1] */
+    void configure(uint32_t bytesPerSec, double busShare, bool lowPriority)
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+
+        rate_ = bytesPerSec;
+        burst_ = bytesPerSec;
+        busShare_ = busShare;
+        lowPriority_ = lowPriority;
+        tokens_ = burst_;
+        refill_ = Clock::now();
+    }
+
+    /* before transaction */
+    void acquire(uint32_t bytes)
+    {
+        Duration wait{0};
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+
+            if(0 == rate_) return;
+
+            const auto now = Clock::now();
+            const auto elapsed = std::chrono::duration<double>(now - refill_).count();
+
+            tokens_ = std::min(double(burst_), tokens_ + elapsed * rate_);
+            refill_ = now;
+            /* tokens may go negative, debt is paid by next callers */
+            tokens_ -= bytes;
+
+            if(0 > tokens_)
+            {
+                wait =
+                    std::chrono::duration_cast<Duration>(
+                        std::chrono::duration<double>(-tokens_ / rate_));
+            }
+        }
+        if(0 < wait.count()) std::this_thread::sleep_for(wait);
+    }
+
+    /* after successful transaction */
+    void release(const Key &key, Duration rtt)
+    {
+        Duration wait{0};
+        {
+            std::lock_guard<std::mutex> lock{mutex_};
+
+            auto i = minRtt_.find(key);
+
+            if(std::end(minRtt_) == i) i = minRtt_.emplace(key, rtt).first;
+            else i->second = std::min(i->second, rtt);
+
+            queueDelay_ = rtt - i->second;
+            lastMinRtt_ = i->second;
+
+            if(1.0 > busShare_)
+            {
+                wait =
+                    std::chrono::duration_cast<Duration>(
+                        rtt * ((1.0 - busShare_) / busShare_));
+            }
+        }
+        if(0 < wait.count()) std::this_thread::sleep_for(wait);
+    }
+
+    /* low priority back-off step, 0 if service is not busy */
+    Duration backoff()
+    {
+        std::lock_guard<std::mutex> lock{mutex_};
+
+        if(!lowPriority_ || queueDelay_ <= lastMinRtt_) return Duration{0};
+        return std::min(maxBackoff(), 4 * queueDelay_);
+    }
+};